@@ -0,0 +1,68 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "bench/bench.hxx"
+#include "time.hxx"
+
+/*
+ * Replaces the global allocation functions to count allocations. The array
+ * and nothrow forms of the standard library forward to these ones, the
+ * aligned ones are replaced too.
+ */
+
+static std::atomic<std::uint64_t> allocations{0};
+
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void *operator new(std::size_t size, std::align_val_t align) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	std::size_t alignment = static_cast<std::size_t>(align);
+	// aligned_alloc wants a nonzero multiple of the alignment
+	std::size_t rounded = size ? (size + alignment - 1) / alignment * alignment : alignment;
+	if (void *p = std::aligned_alloc(alignment, rounded))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+	std::free(p);
+}
+
+std::uint64_t allocation_count() noexcept {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+std::uint64_t bench_hash(void const *data, std::size_t size, std::uint64_t h) noexcept {
+	auto bytes = static_cast<unsigned char const *>(data);
+	for (std::size_t k = 0; k < size; k++)
+		h = (h ^ bytes[k]) * 1099511628211ULL;
+	return h;
+}
+
+void BenchTimer::start() {
+	a0 = allocation_count();
+	t0 = wall ? monotonic_clock() : thread_cpu_clock();
+}
+
+void BenchTimer::stop() {
+	timespec t1 = wall ? monotonic_clock() : thread_cpu_clock();
+	elapsed += to_double(t1 - t0);
+	allocs += allocation_count() - a0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <time.h>
+
+/// Number of `operator new` calls so far, in all threads.
+std::uint64_t allocation_count() noexcept;
+
+/// FNV-1a of `size` bytes at `data`, continuing from `h`.
+std::uint64_t bench_hash(void const *data, std::size_t size, std::uint64_t h = 14695981039346656037ULL) noexcept;
+
+/// Measures the parts of a benchmark run between start() and stop(), so that
+/// the setup of each run is left out. Counts CPU time of the calling thread,
+/// or wall time if @p wall is set (for benchmarks using several threads).
+class BenchTimer {
+public:
+	explicit BenchTimer(bool wall = false) : wall(wall) {}
+	void start();
+	void stop();
+	double seconds() const { return elapsed; }
+	std::uint64_t allocations() const { return allocs; }
+
+private:
+	bool wall;
+	timespec t0;
+	std::uint64_t a0 = 0;
+	double elapsed = 0.0;
+	std::uint64_t allocs = 0;
+};
+
+/// One benchmark. A run performs `ops` operations over `nodes` nodes in total
+/// and returns a hash of its output, which must not depend on the run.
+struct BenchCase {
+	std::string name;
+	long ops;
+	long nodes;
+	std::function<std::uint64_t(BenchTimer &)> run;
+	bool wall_clock = false; ///< see BenchTimer
+};
+
+/// noise2d/3d, NoisePerlin2D/3D and perlinMap2D/3D.
+void add_noise_benchmarks(std::vector<BenchCase> &cases);
+
+/// MapgenV6 stages, make_slices and make_mesh.
+void add_mapgen_benchmarks(std::vector<BenchCase> &cases);
+
+/// Error and speed of NOISE_FLAG_POINTBUFFER against full evaluation.
+void pointbuffer_benchmark();
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fmt/printf.h>
+#include "bench/bench.hxx"
+#include "mapgen/minetest/common/noise_simd.hxx"
+#include "time.hxx"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr double min_time = 0.2; ///< measured seconds per case, at least
+constexpr double max_wall_time = 5.0; ///< seconds per case, at most
+constexpr int min_runs = 3;
+
+struct Result {
+	std::string name;
+	long ops;
+	long nodes;
+	int runs;
+	double seconds; ///< of all the measured runs
+	std::uint64_t allocations; ///< of all the measured runs
+	std::uint64_t hash;
+
+	double ns_per_op() const { return 1e9 * seconds / (runs * ops); }
+	double nodes_per_second() const { return runs * nodes / seconds; }
+	double allocations_per_op() const { return (double)allocations / (runs * ops); }
+};
+
+using File = std::unique_ptr<std::FILE, int (*)(std::FILE *)>;
+
+File open(fs::path const &path, char const *mode) {
+	File file{std::fopen(path.c_str(), mode), std::fclose};
+	if (!file)
+		throw std::system_error(errno, std::system_category(), "Can't open " + path.native());
+	return file;
+}
+
+Result run(BenchCase const &c) {
+	Result result{c.name, c.ops, c.nodes, 0, 0.0, 0, 0};
+	BenchTimer warmup(c.wall_clock);
+	result.hash = c.run(warmup);
+	BenchTimer timer(c.wall_clock);
+	timespec t0 = monotonic_clock();
+	while (result.runs < min_runs || (timer.seconds() < min_time && to_double(monotonic_clock() - t0) < max_wall_time)) {
+		std::uint64_t hash = c.run(timer);
+		if (hash != result.hash)
+			throw std::logic_error(c.name + " gives a different result each run");
+		result.runs++;
+	}
+	result.seconds = timer.seconds();
+	result.allocations = timer.allocations();
+	return result;
+}
+
+void write_csv(std::FILE *file, std::vector<Result> const &results) {
+	fmt::fprintf(file, "name,runs,ops,ns_per_op,nodes_per_s,allocs_per_op,hash\n");
+	for (auto const &r: results)
+		fmt::fprintf(file, "%s,%d,%d,%.1f,%.0f,%.2f,%016x\n", r.name, r.runs, r.ops,
+			r.ns_per_op(), r.nodes_per_second(), r.allocations_per_op(), r.hash);
+}
+
+void write_json(std::FILE *file, std::vector<Result> const &results) {
+	fmt::fprintf(file, "{\"benchmarks\": [\n");
+	for (std::size_t k = 0; k < results.size(); k++) {
+		auto const &r = results[k];
+		fmt::fprintf(file, "\t{\"name\": \"%s\", \"runs\": %d, \"ops\": %d, \"ns_per_op\": %.1f, \"nodes_per_s\": %.0f, \"allocs_per_op\": %.2f, \"hash\": \"%016x\"}%s\n",
+			r.name, r.runs, r.ops, r.ns_per_op(), r.nodes_per_second(), r.allocations_per_op(), r.hash,
+			k + 1 < results.size() ? "," : "");
+	}
+	fmt::fprintf(file, "]}\n");
+}
+
+void write_results(fs::path const &path, std::vector<Result> const &results) {
+	File file = open(path, "w");
+	if (path.extension() == ".json")
+		write_json(file.get(), results);
+	else
+		write_csv(file.get(), results);
+}
+
+void write_hashes(fs::path const &path, std::vector<Result> const &results) {
+	File file = open(path, "w");
+	for (auto const &r: results)
+		fmt::fprintf(file.get(), "%s %016x\n", r.name, r.hash);
+}
+
+/// Number of cases whose hash differs from the one recorded in the file
+int check_hashes(fs::path const &path, std::vector<Result> const &results) {
+	File file = open(path, "r");
+	std::map<std::string, std::uint64_t> expected;
+	char name[256];
+	unsigned long long hash;
+	while (std::fscanf(file.get(), "%255s %llx", name, &hash) == 2)
+		expected[name] = hash;
+	int mismatches = 0;
+	for (auto const &r: results) {
+		auto it = expected.find(r.name);
+		if (it == expected.end()) {
+			fmt::printf("%s: no recorded hash\n", r.name);
+			continue;
+		}
+		if (it->second != r.hash) {
+			fmt::printf("%s: hash %016x, expected %016x\n", r.name, r.hash, it->second);
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+void usage(char const *name) {
+	fmt::printf("Usage: %s [--output FILE] [--hashes FILE] [--write-hashes FILE] [FILTER...]\n", name);
+	fmt::printf("       %s --pointbuffer\n", name);
+}
+
+}
+
+int main(int argc, char **argv) {
+	fs::path output, hashes, new_hashes;
+	std::vector<std::string> filters;
+	for (int k = 1; k < argc; k++) {
+		auto value = [&] {
+			if (++k >= argc) {
+				usage(argv[0]);
+				std::exit(1);
+			}
+			return argv[k];
+		};
+		if (std::strcmp(argv[k], "--pointbuffer") == 0) {
+			pointbuffer_benchmark();
+			return 0;
+		} else if (std::strcmp(argv[k], "--output") == 0) {
+			output = value();
+		} else if (std::strcmp(argv[k], "--hashes") == 0) {
+			hashes = value();
+		} else if (std::strcmp(argv[k], "--write-hashes") == 0) {
+			new_hashes = value();
+		} else if (argv[k][0] == '-') {
+			usage(argv[0]);
+			return 1;
+		} else {
+			filters.push_back(argv[k]);
+		}
+	}
+
+	std::vector<BenchCase> cases;
+	add_noise_benchmarks(cases);
+	add_mapgen_benchmarks(cases);
+
+	fmt::printf("Noise kernels: %s\n", noise_kernel_isa);
+	std::vector<Result> results;
+	fmt::printf("%-28s %6s %12s %14s %10s %16s\n", "benchmark", "runs", "ns/op", "nodes/s", "allocs/op", "hash");
+	for (auto const &c: cases) {
+		bool selected = filters.empty() || std::any_of(filters.begin(), filters.end(), [&] (std::string const &f) {
+			return c.name.find(f) != std::string::npos;
+		});
+		if (!selected)
+			continue;
+		Result r = run(c);
+		fmt::printf("%-28s %6d %12.1f %14.4g %10.2f %016x\n", r.name, r.runs, r.ns_per_op(),
+			r.nodes_per_second(), r.allocations_per_op(), r.hash);
+		std::fflush(stdout);
+		results.push_back(r);
+	}
+
+	if (!output.empty())
+		write_results(output, results);
+	if (!new_hashes.empty())
+		write_hashes(new_hashes, results);
+	if (!hashes.empty()) {
+		int mismatches = check_hashes(hashes, results);
+		if (mismatches) {
+			fmt::printf("%d benchmarks changed their output\n", mismatches);
+			return 1;
+		}
+		fmt::printf("All hashes match\n");
+	}
+	return 0;
+}
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+#include "bench/bench.hxx"
+#include "mapgen/heightmap.hxx"
+#include "mapgen/minetest_v6.hxx"
+#include "mapgen/minetest/common/map.hxx"
+#include "mapgen/minetest/v6/mapgen_v6.hxx"
+#include <meshgen/slicing.hxx>
+#include <meshgen/meshing.hxx>
+
+namespace {
+
+constexpr int chunks = 4; ///< per run, side by side along x
+constexpr int chunk_size = 5; ///< in blocks, the one Map uses by default
+constexpr long chunk_nodes = block_data_size * chunk_size * chunk_size * chunk_size;
+
+/// Stages of MapgenV6::makeChunk, in order
+enum class Stage {
+	Noise,
+	Ground,
+	Mud,
+	Flow,
+	Caves,
+	Grass,
+	Trees,
+	Light,
+	All,
+};
+
+/// Same setup as Map::requestBlock
+std::unique_ptr<MapgenV6> make_mapgen(int size = chunk_size) {
+	static MapgenV6Params params;
+	params.seed = 666;
+	params.chunksize = size;
+	return std::make_unique<MapgenV6>(&params, mapgen_v6_content_ids());
+}
+
+/// @p layer counts chunks up from the one at the ground level
+glm::ivec3 chunk_base(int k, int layer = 0, int size = chunk_size) {
+	return glm::ivec3{size * k, 0, size * layer} - size / 2;
+}
+
+std::unique_ptr<MMVManip> make_manip(glm::ivec3 base, int size = chunk_size) {
+	return std::make_unique<MMVManip>(base - CHUNK_PADDING_BLOCKS, base + (size + CHUNK_PADDING_BLOCKS - 1));
+}
+
+BlockMakeData make_data(MMVManip &vm, glm::ivec3 base, s32 seed, int size = chunk_size) {
+	BlockMakeData bmd;
+	bmd.seed = seed;
+	bmd.vmanip = &vm;
+	bmd.blockpos_min = vcore_to_mt(base);
+	bmd.blockpos_max = vcore_to_mt(base + (size - 1));
+	return bmd;
+}
+
+std::uint64_t hash_chunk(MMVManip const &vm, std::uint64_t h) {
+	for (auto pos: space_range{vm.bstart, vm.bstart + vm.bsize})
+		h = bench_hash(vm.getBlock(pos).qube, sizeof(Block::qube), h);
+	return h;
+}
+
+std::uint64_t hash_noise(MapgenV6 const &mapgen, std::uint64_t h) {
+	auto hash_map = [&] (Noise const *noise) {
+		h = bench_hash(noise->result, noise->sx * noise->sy * sizeof(float), h);
+	};
+	h = bench_hash(mapgen.terrain_level, mapgen.csize.x * mapgen.csize.z * sizeof(float), h);
+	hash_map(mapgen.noise_beach);
+	hash_map(mapgen.noise_biome);
+	hash_map(mapgen.noise_humidity);
+	return h;
+}
+
+/// Runs makeChunk up to the `measured` stage, timing only that one.
+/// @p reference_mudflow is for flowMudReference instead of flowMud.
+void generate(MapgenV6 &mapgen, BlockMakeData *bmd, Stage measured, BenchTimer &timer, bool reference_mudflow = false) {
+	if (measured == Stage::All) {
+		timer.start();
+		mapgen.makeChunk(bmd);
+		timer.stop();
+		return;
+	}
+	mapgen.prepareChunk(bmd);
+	auto step = [&] (Stage stage, auto &&fn) {
+		if (stage > measured)
+			return;
+		if (stage == measured)
+			timer.start();
+		fn();
+		if (stage == measured)
+			timer.stop();
+	};
+	step(Stage::Noise, [&] { mapgen.calculateNoise(); });
+	int stone_surface_max_y = 0;
+	step(Stage::Ground, [&] { stone_surface_max_y = mapgen.generateGround(); });
+	for (int age = 0; age < 2; age++) {
+		step(Stage::Mud, [&] { mapgen.addMud(); });
+		step(Stage::Flow, [&] {
+			// makeChunk limits it to the chunk, as the padding is not generated
+			s16 mudflow_minpos = 0;
+			s16 mudflow_maxpos = mapgen.csize.x - 1;
+			if (!reference_mudflow) {
+				mapgen.flowMud(mudflow_minpos, mudflow_maxpos);
+				return;
+			}
+			mapgen.flowMudReference(mudflow_minpos, mudflow_maxpos);
+			mapgen.updateHeightmap(mapgen.node_min, mapgen.node_max);
+		});
+	}
+	step(Stage::Caves, [&] { mapgen.generateCaves(stone_surface_max_y); });
+	step(Stage::Grass, [&] { mapgen.growGrass(); });
+	step(Stage::Trees, [&] { mapgen.placeTreesAndJungleGrass(); });
+	step(Stage::Light, [&] {
+		mapgen.calcLighting(mapgen.node_min, mapgen.node_max, false, mapgen.terrainSurface());
+	});
+	mapgen.generating = false;
+}
+
+/// @p pool is for the latency mode, timed by wall clock then
+void add_stage(std::vector<BenchCase> &cases, std::string name, Stage stage, TaskPool *pool = nullptr, int layer = 0,
+		bool reference_mudflow = false) {
+	cases.push_back({name, chunks, chunks * chunk_nodes, [stage, pool, layer, reference_mudflow] (BenchTimer &timer) {
+		auto mapgen = make_mapgen();
+		mapgen->task_pool = pool;
+		std::uint64_t h = bench_hash(nullptr, 0);
+		for (int k = 0; k < chunks; k++) {
+			auto vm = make_manip(chunk_base(k, layer));
+			BlockMakeData bmd = make_data(*vm, chunk_base(k, layer), mapgen->seed);
+			generate(*mapgen, &bmd, stage, timer, reference_mudflow);
+			h = stage == Stage::Noise ? hash_noise(*mapgen, h) : hash_chunk(*vm, h);
+		}
+		return h;
+	}, pool != nullptr});
+}
+
+/// makeChunk at each chunk size, over about the same volume per run: ns/op
+/// is the latency of a chunk, nodes/s the throughput
+void add_chunk_size_benchmarks(std::vector<BenchCase> &cases) {
+	for (int size = 1; size <= 8; size++) {
+		long nodes = block_data_size * size * size * size;
+		int count = std::max(1L, chunks * chunk_nodes / nodes);
+		cases.push_back({fmt::format("MapgenV6/makeChunk/size{}", size), count, count * nodes, [size, count] (BenchTimer &timer) {
+			auto mapgen = make_mapgen(size);
+			std::uint64_t h = bench_hash(nullptr, 0);
+			for (int k = 0; k < count; k++) {
+				auto vm = make_manip(chunk_base(k, 0, size), size);
+				BlockMakeData bmd = make_data(*vm, chunk_base(k, 0, size), mapgen->seed, size);
+				generate(*mapgen, &bmd, Stage::All, timer);
+				h = hash_chunk(*vm, h);
+			}
+			return h;
+		}});
+	}
+}
+
+/// Throws if sunlight reached into a column the terrain goes on above
+void check_buried_columns(MapgenV6 &mapgen, MMVManip const &vm) {
+	s16 const *surface = mapgen.terrainSurface();
+	for (s16 z = mapgen.node_min.z; z <= mapgen.node_max.z; z++)
+	for (s16 x = mapgen.node_min.x; x <= mapgen.node_max.x; x++) {
+		int index = (x - mapgen.node_min.x) + mapgen.csize.x * (z - mapgen.node_min.z);
+		if (surface[index] < mapgen.node_max.y)
+			continue;
+		for (s16 y = mapgen.node_min.y; y <= mapgen.node_max.y; y++)
+			if ((vm.get_r({x, y, z}).light & 0x0F) == LIGHT_SUN)
+				throw std::logic_error(fmt::format("Sunlight at {}, {}, {} under the terrain", x, y, z));
+	}
+}
+
+/// calcLighting on 2-block chunks whose caves reach their top where the
+/// terrain rises above it; these must not get sunlight from the top
+void add_buried_light_benchmark(std::vector<BenchCase> &cases) {
+	constexpr int size = 2;
+	constexpr int first = 22; ///< along x, the first such chunk for the seed
+	constexpr long nodes = block_data_size * size * size * size;
+	cases.push_back({"MapgenV6/calcLighting/buried", chunks, chunks * nodes, [] (BenchTimer &timer) {
+		auto mapgen = make_mapgen(size);
+		std::uint64_t h = bench_hash(nullptr, 0);
+		for (int k = first; k < first + chunks; k++) {
+			auto vm = make_manip(chunk_base(k, 0, size), size);
+			BlockMakeData bmd = make_data(*vm, chunk_base(k, 0, size), mapgen->seed, size);
+			generate(*mapgen, &bmd, Stage::Light, timer);
+			check_buried_columns(*mapgen, *vm);
+			h = hash_chunk(*vm, h);
+		}
+		return h;
+	}});
+}
+
+void add_heightmap_benchmark(std::vector<BenchCase> &cases) {
+	cases.push_back({"HeightmapMapgen/generate", chunks, chunks * chunk_nodes, [] (BenchTimer &timer) {
+		HeightmapMapgen mapgen(fractal_heightmap(666, 4096));
+		std::uint64_t h = bench_hash(nullptr, 0);
+		for (int k = 0; k < chunks; k++) {
+			auto vm = make_manip(chunk_base(k));
+			timer.start();
+			mapgen.generate(*vm, chunk_base(k));
+			timer.stop();
+			h = hash_chunk(*vm, h);
+		}
+		return h;
+	}});
+}
+
+/// A generated chunk, the same for all the meshgen runs
+MMVManip &mesh_chunk() {
+	static std::unique_ptr<MMVManip> vm = [] {
+		auto mapgen = make_mapgen();
+		auto vm = make_manip(chunk_base(0));
+		BlockMakeData bmd = make_data(*vm, chunk_base(0), mapgen->seed);
+		mapgen->makeChunk(&bmd);
+		return vm;
+	}();
+	return *vm;
+}
+
+/// Blocks of the chunk that have all their neighbours in it too
+std::vector<glm::ivec3> mesh_blocks() {
+	std::vector<glm::ivec3> blocks;
+	glm::ivec3 base = chunk_base(0);
+	for (auto pos: space_range{base + 1, base + (chunk_size - 1)})
+		blocks.push_back(pos);
+	return blocks;
+}
+
+VManip mesh_manip(glm::ivec3 blockpos) {
+	MMVManip &chunk = mesh_chunk();
+	return VManip{blockpos - 1, blockpos + 1, [&chunk] (glm::ivec3 pos) {
+		return &chunk.getBlock(pos);
+	}};
+}
+
+void add_meshgen_benchmarks(std::vector<BenchCase> &cases) {
+	long blocks = mesh_blocks().size();
+	cases.push_back({"make_slices", blocks, blocks * block_data_size, [] (BenchTimer &timer) {
+		std::uint64_t h = bench_hash(nullptr, 0);
+		for (auto pos: mesh_blocks()) {
+			VManip vm = mesh_manip(pos);
+			timer.start();
+			auto slices = make_slices(vm, pos);
+			timer.stop();
+			h = bench_hash(&slices, sizeof(slices), h);
+		}
+		return h;
+	}});
+	cases.push_back({"make_mesh", blocks, blocks * block_data_size, [] (BenchTimer &timer) {
+		std::uint64_t h = bench_hash(nullptr, 0);
+		std::vector<glm::ivec3> positions = mesh_blocks();
+		std::vector<SliceSet<>> slices;
+		for (auto pos: positions)
+			slices.push_back(make_slices(mesh_manip(pos), pos));
+		for (std::size_t k = 0; k < positions.size(); k++) {
+			timer.start();
+			auto mesh = make_mesh(slices[k], MAP_BLOCKSIZE * positions[k]);
+			timer.stop();
+			h = bench_hash(mesh->vertices.data(), mesh->vertices.size() * sizeof(Vertex), h);
+		}
+		return h;
+	}});
+}
+
+}
+
+void add_mapgen_benchmarks(std::vector<BenchCase> &cases) {
+	add_stage(cases, "MapgenV6/calculateNoise", Stage::Noise);
+	add_stage(cases, "MapgenV6/generateGround", Stage::Ground);
+	add_stage(cases, "MapgenV6/addMud", Stage::Mud);
+	add_stage(cases, "MapgenV6/flowMud", Stage::Flow);
+	add_stage(cases, "MapgenV6/flowMud/reference", Stage::Flow, nullptr, 0, true);
+	add_stage(cases, "MapgenV6/generateCaves", Stage::Caves);
+	add_stage(cases, "MapgenV6/generateCaves/deep", Stage::Caves, nullptr, -2);
+	add_stage(cases, "MapgenV6/growGrass", Stage::Grass);
+	add_stage(cases, "MapgenV6/placeTreesAndJungleGrass", Stage::Trees);
+	add_stage(cases, "MapgenV6/calcLighting", Stage::Light);
+	add_buried_light_benchmark(cases);
+	add_stage(cases, "MapgenV6/makeChunk", Stage::All);
+	static TaskPool pool; // as many threads as there are cores
+	add_stage(cases, "MapgenV6/generateGround/latency", Stage::Ground, &pool);
+	add_stage(cases, "MapgenV6/makeChunk/latency", Stage::All, &pool);
+	add_stage(cases, "MapgenV6/makeChunk/sky", Stage::All, nullptr, 2);
+	add_stage(cases, "MapgenV6/makeChunk/deep", Stage::All, nullptr, -2);
+	add_chunk_size_benchmarks(cases);
+	add_heightmap_benchmark(cases);
+	add_meshgen_benchmarks(cases);
+}
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <fmt/format.h>
+#include "bench/bench.hxx"
+#include "mapgen/minetest/common/noise.hxx"
+#include "util/perlin.hxx"
+
+namespace {
+
+constexpr s32 seed = 1337;
+constexpr long points = 4096; ///< per run of the point benchmarks
+constexpr long map_nodes = 1 << 20; ///< per run of the map benchmarks, roughly
+
+NoiseParams params(int octaves, u32 flags = NOISE_FLAG_DEFAULTS) {
+	return NoiseParams(0, 1, v3f(250, 250, 250), 5333, octaves, 0.6, 2.0, flags);
+}
+
+/// Walks points in a pattern that does not repeat within a run
+float coord(long k, float step) {
+	return (k % 61) * step + (k / 61) * 0.37f * step;
+}
+
+void add_point_benchmarks(std::vector<BenchCase> &cases) {
+	cases.push_back({"noise2d", points, points, [] (BenchTimer &timer) {
+		std::vector<float> out(points);
+		timer.start();
+		for (long k = 0; k < points; k++)
+			out[k] = noise2d(k % 64, k / 64, seed);
+		timer.stop();
+		return bench_hash(out.data(), out.size() * sizeof(float));
+	}});
+	cases.push_back({"noise3d", points, points, [] (BenchTimer &timer) {
+		std::vector<float> out(points);
+		timer.start();
+		for (long k = 0; k < points; k++)
+			out[k] = noise3d(k % 16, k / 16 % 16, k / 256, seed);
+		timer.stop();
+		return bench_hash(out.data(), out.size() * sizeof(float));
+	}});
+	for (int octaves: {1, 3, 5}) {
+		cases.push_back({fmt::format("NoisePerlin2D/o{}", octaves), points, points, [octaves] (BenchTimer &timer) {
+			NoiseParams np = params(octaves);
+			std::vector<float> out(points);
+			timer.start();
+			for (long k = 0; k < points; k++)
+				out[k] = NoisePerlin2D(&np, coord(k, 7.0f), coord(k + 29, 5.0f), seed);
+			timer.stop();
+			return bench_hash(out.data(), out.size() * sizeof(float));
+		}});
+		cases.push_back({fmt::format("NoisePerlin3D/o{}", octaves), points, points, [octaves] (BenchTimer &timer) {
+			NoiseParams np = params(octaves);
+			std::vector<float> out(points);
+			timer.start();
+			for (long k = 0; k < points; k++)
+				out[k] = NoisePerlin3D(&np, coord(k, 7.0f), coord(k + 29, 5.0f), coord(k + 43, 3.0f), seed);
+			timer.stop();
+			return bench_hash(out.data(), out.size() * sizeof(float));
+		}});
+	}
+	// Simplex is opt-in, measured against the lattice of the default flags
+	cases.push_back({"NoisePerlin3D/o3/simplex", points, points, [] (BenchTimer &timer) {
+		NoiseParams np = params(3, NOISE_FLAG_SIMPLEX);
+		std::vector<float> out(points);
+		timer.start();
+		for (long k = 0; k < points; k++)
+			out[k] = NoisePerlin3D(&np, coord(k, 7.0f), coord(k + 29, 5.0f), coord(k + 43, 3.0f), seed);
+		timer.stop();
+		return bench_hash(out.data(), out.size() * sizeof(float));
+	}});
+}
+
+void add_map_benchmarks(std::vector<BenchCase> &cases) {
+	for (int octaves: {1, 3, 5}) {
+		for (int size: {16, 80, 256}) {
+			long nodes = size * size;
+			long ops = std::max(1L, map_nodes / nodes);
+			cases.push_back({fmt::format("perlinMap2D/{}/o{}", size, octaves), ops, ops * nodes, [=] (BenchTimer &timer) {
+				NoiseParams np = params(octaves);
+				Noise noise(&np, seed, size, size);
+				std::uint64_t h = bench_hash(nullptr, 0);
+				for (long k = 0; k < ops; k++) {
+					timer.start();
+					float const *map = noise.perlinMap2D(k * size, -k * size);
+					timer.stop();
+					h = bench_hash(map, nodes * sizeof(float), h);
+				}
+				return h;
+			}});
+		}
+		for (int size: {16, 40, 80}) {
+			long nodes = size * size * size;
+			long ops = std::max(1L, map_nodes / nodes);
+			cases.push_back({fmt::format("perlinMap3D/{}/o{}", size, octaves), ops, ops * nodes, [=] (BenchTimer &timer) {
+				NoiseParams np = params(octaves);
+				Noise noise(&np, seed, size, size, size);
+				std::uint64_t h = bench_hash(nullptr, 0);
+				for (long k = 0; k < ops; k++) {
+					timer.start();
+					float const *map = noise.perlinMap3D(k * size, -size, -k * size);
+					timer.stop();
+					h = bench_hash(map, nodes * sizeof(float), h);
+				}
+				return h;
+			}});
+		}
+	}
+	{
+		constexpr int size = 80;
+		long nodes = size * size * size;
+		long ops = std::max(1L, map_nodes / nodes);
+		cases.push_back({"perlinMap3D/80/o3/simplex", ops, ops * nodes, [=] (BenchTimer &timer) {
+			NoiseParams np = params(3, NOISE_FLAG_SIMPLEX);
+			Noise noise(&np, seed, size, size, size);
+			std::uint64_t h = bench_hash(nullptr, 0);
+			for (long k = 0; k < ops; k++) {
+				timer.start();
+				float const *map = noise.perlinMap3D(k * size, -size, -k * size);
+				timer.stop();
+				h = bench_hash(map, nodes * sizeof(float), h);
+			}
+			return h;
+		}});
+	}
+}
+
+/// util/perlin at the same sizes as perlinMap2D; its domain is finite, so the maps are tiled
+void add_fractal_benchmarks(std::vector<BenchCase> &cases) {
+	constexpr int tiles = 64; ///< per row
+	constexpr float cell = 250.0f; ///< same as the spread of params()
+	for (int octaves: {1, 3, 5}) {
+		cases.push_back({fmt::format("FractalNoise2d/point/o{}", octaves), points, points, [octaves] (BenchTimer &timer) {
+			FractalNoise2d noise(1024, 1024, cell, octaves);
+			noise.generate(seed);
+			std::vector<float> out(points);
+			timer.start();
+			for (long k = 0; k < points; k++)
+				out[k] = noise.get(coord(k, 7.0f), coord(k + 29, 5.0f));
+			timer.stop();
+			return bench_hash(out.data(), out.size() * sizeof(float));
+		}});
+		for (int size: {16, 80, 256}) {
+			long nodes = size * size;
+			long ops = std::max(1L, map_nodes / nodes);
+			cases.push_back({fmt::format("FractalNoise2d/{}/o{}", size, octaves), ops, ops * nodes, [=] (BenchTimer &timer) {
+				long width = std::min<long>(ops, tiles);
+				long height = (ops + tiles - 1) / tiles;
+				FractalNoise2d noise(width * size + 1, height * size + 1, cell, octaves);
+				noise.generate(seed);
+				std::vector<float> map(nodes);
+				std::uint64_t h = bench_hash(nullptr, 0);
+				for (long k = 0; k < ops; k++) {
+					glm::vec2 origin(k % tiles * size, k / tiles * size);
+					timer.start();
+					noise.get(map.data(), {size, size}, origin, {1.0f, 1.0f});
+					timer.stop();
+					h = bench_hash(map.data(), nodes * sizeof(float), h);
+				}
+				return h;
+			}});
+		}
+	}
+}
+
+}
+
+void add_noise_benchmarks(std::vector<BenchCase> &cases) {
+	add_point_benchmarks(cases);
+	add_map_benchmarks(cases);
+	add_fractal_benchmarks(cases);
+}
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <fmt/printf.h>
+#include "bench/bench.hxx"
+#include "mapgen/minetest/common/noise.hxx"
+#include "time.hxx"
+
+namespace {
+
+constexpr int chunk = 80;
+constexpr int chunks = 8;
+constexpr int repeats = 3;
+
+struct Case {
+	char const *name;
+	NoiseParams np;
+};
+
+/// Maps of all the chunks, and the best CPU time of one map
+double evaluate(Noise &noise, std::vector<float> &maps) {
+	double best = HUGE_VAL;
+	for (int r = 0; r < repeats; r++) {
+		maps.clear();
+		timespec t0 = thread_cpu_clock();
+		for (int c = 0; c < chunks; c++) {
+			float const *map = noise.perlinMap3D(c * chunk, -chunk, (c % 3) * chunk);
+			maps.insert(maps.end(), map, map + chunk * chunk * chunk);
+		}
+		best = std::min(best, to_double(thread_cpu_clock() - t0) / chunks);
+	}
+	return best;
+}
+
+}
+
+void pointbuffer_benchmark() {
+	Case const cases[] = {
+		{"cave", NoiseParams(0, 12, v3f(61, 61, 61), 52534, 3, 0.5, 2.0)},
+		{"large", NoiseParams(0, 1, v3f(250, 250, 250), 5333, 5, 0.63, 2.0)},
+		{"detail", NoiseParams(0, 1, v3f(24, 24, 24), 1234, 3, 0.5, 2.0)},
+	};
+	fmt::printf("%-8s %8s %10s %8s %10s %10s\n", "noise", "spacing", "ms/chunk", "speedup", "rms err", "max err");
+	for (auto const &c: cases) {
+		std::vector<float> exact, approx;
+		Noise full(const_cast<NoiseParams *>(&c.np), 0, chunk, chunk, chunk);
+		double t_full = evaluate(full, exact);
+		auto range = std::minmax_element(exact.begin(), exact.end());
+		float amplitude = *range.second - *range.first;
+		fmt::printf("%-8s %8d %10.2f %8.2f %10s %10s\n", c.name, 1, 1e3 * t_full, 1.0, "-", "-");
+
+		// spacings larger than the finest lattice cell are capped, see Noise::pointBufferSpacing
+		for (int spacing: {2, 4, 8}) {
+			NoiseParams np = c.np;
+			np.flags |= NOISE_FLAG_POINTBUFFER;
+			np.point_spacing = spacing;
+			Noise sparse(&np, 0, chunk, chunk, chunk);
+			double t = evaluate(sparse, approx);
+			double sum2 = 0.0;
+			float max_err = 0.0f;
+			for (std::size_t k = 0; k < exact.size(); k++) {
+				float err = std::fabs(approx[k] - exact[k]);
+				sum2 += err * err;
+				max_err = std::max(max_err, err);
+			}
+			// errors are relative to the value range of the exact maps
+			float rms = std::sqrt(sum2 / exact.size());
+			fmt::printf("%-8s %8d %10.2f %8.2f %9.2f%% %9.2f%%\n", c.name, sparse.pointBufferSpacing(), 1e3 * t, t_full / t,
+				100.0f * rms / amplitude, 100.0f * max_err / amplitude);
+		}
+	}
+}
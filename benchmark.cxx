@@ -0,0 +1,66 @@
+#include "benchmark.hxx"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <system_error>
+#include <fmt/printf.h>
+#include <glm/gtc/constants.hpp>
+
+CameraPose benchmark_camera(int frame, int frame_count, glm::vec3 center, float radius) {
+	float phase = glm::two_pi<float>() * frame / frame_count;
+	CameraPose pose;
+	pose.eye_pos = center + radius * glm::vec3{std::cos(phase), std::sin(phase), 0.0f};
+	pose.yaw = -phase;
+	pose.pitch = 0.3f * std::sin(2.0f * phase);
+	return pose;
+}
+
+void BenchmarkLog::write(std::filesystem::path const &path) const {
+	std::unique_ptr<std::FILE, int (*)(std::FILE *)> file{std::fopen(path.c_str(), "w"), std::fclose};
+	if (!file)
+		throw std::system_error(errno, std::system_category(), "Can't open " + path.native());
+	if (path.extension() == ".json")
+		write_json(file.get());
+	else
+		write_csv(file.get());
+}
+
+void BenchmarkLog::write_csv(std::FILE *file) const {
+	fmt::fprintf(file, "frame,cpu_ms,wall_ms,gpu_terrain_ms,gpu_overlay_ms,draws,vertices,upload_bytes\n");
+	for (std::size_t k = 0; k < frames.size(); k++) {
+		auto const &f = frames[k];
+		fmt::fprintf(file, "%d,%.3f,%.3f,%.3f,%.3f,%d,%d,%d\n", k, 1e3 * f.cpu_time, 1e3 * f.wall_time,
+			1e3 * f.gpu_terrain_time, 1e3 * f.gpu_overlay_time, f.stats.draws, f.stats.vertices, f.stats.upload_bytes);
+	}
+}
+
+void BenchmarkLog::write_json(std::FILE *file) const {
+	fmt::fprintf(file, "{\"frames\": [\n");
+	for (std::size_t k = 0; k < frames.size(); k++) {
+		auto const &f = frames[k];
+		fmt::fprintf(file, "\t{\"frame\": %d, \"cpu_ms\": %.3f, \"wall_ms\": %.3f, \"gpu_terrain_ms\": %.3f, \"gpu_overlay_ms\": %.3f, \"draws\": %d, \"vertices\": %d, \"upload_bytes\": %d}%s\n",
+			k, 1e3 * f.cpu_time, 1e3 * f.wall_time, 1e3 * f.gpu_terrain_time, 1e3 * f.gpu_overlay_time,
+			f.stats.draws, f.stats.vertices, f.stats.upload_bytes,
+			k + 1 < frames.size() ? "," : "");
+	}
+	fmt::fprintf(file, "]}\n");
+}
+
+void BenchmarkLog::print_summary() const {
+	if (frames.empty())
+		return;
+	std::vector<double> cpu, wall;
+	for (auto const &f: frames) {
+		cpu.push_back(f.cpu_time);
+		wall.push_back(f.wall_time);
+	}
+	auto percentile = [] (std::vector<double> &v, double p) {
+		auto nth = v.begin() + std::min<std::size_t>(p * v.size(), v.size() - 1);
+		std::nth_element(v.begin(), nth, v.end());
+		return 1e3 * *nth;
+	};
+	fmt::printf("Benchmark: %d frames\n", frames.size());
+	fmt::printf("CPU time: %.3f ms p50, %.3f ms p99\n", percentile(cpu, 0.50), percentile(cpu, 0.99));
+	fmt::printf("Wall time: %.3f ms p50, %.3f ms p99\n", percentile(wall, 0.50), percentile(wall, 0.99));
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+#include <glm/vec3.hpp>
+
+/// What a frame asked of the GPU.
+struct FrameStats {
+	int draws = 0;
+	long vertices = 0;
+	std::size_t upload_bytes = 0;
+};
+
+struct BenchmarkFrame {
+	double cpu_time; ///< Render thread CPU time, in seconds
+	double wall_time; ///< Wall time until the GPU finished the frame, in seconds
+	double gpu_terrain_time; ///< GPU time of the terrain pass, in seconds
+	double gpu_overlay_time; ///< GPU time of the overlay pass, in seconds
+	FrameStats stats;
+};
+
+/// A point of the benchmark camera path.
+struct CameraPose {
+	glm::vec3 eye_pos;
+	float yaw;
+	float pitch;
+};
+
+/// Deterministic camera path: one lap around @p center at @p radius, with the
+/// view swinging up and down a bit so that both near and far terrain get drawn.
+CameraPose benchmark_camera(int frame, int frame_count, glm::vec3 center, float radius);
+
+class BenchmarkLog {
+public:
+	void add(BenchmarkFrame const &frame) { frames.push_back(frame); }
+
+	/// Writes one record per frame, as JSON if @p path ends with `.json` and
+	/// as CSV otherwise.
+	void write(std::filesystem::path const &path) const;
+	void print_summary() const;
+
+private:
+	std::vector<BenchmarkFrame> frames;
+
+	void write_csv(std::FILE *file) const;
+	void write_json(std::FILE *file) const;
+};
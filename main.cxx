@@ -1,11 +1,14 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <memory>
 #include <mutex>
 #include <random>
+#include <string_view>
 #include <thread>
 #include <typeinfo>
 #include <unordered_map>
@@ -15,15 +18,21 @@
 #include <gl++/c.hxx>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
-#include <SDL2/SDL_surface.h>
 #include <SDL2/SDL_image.h>
+#include "benchmark.hxx"
 #include "shader.hxx"
 #include "time.hxx"
 #include "mesh.hxx"
+#include "passtimer.hxx"
 #include "map/map.hxx"
+#include "mapgen/heightmap.hxx"
+#include "mapgen/minetest_v6.hxx"
+#include "mapgen/minetest/common/profiler.hxx"
 #include "util/io.hxx"
 #include "terminal/gltty.hxx"
+#include "textures.hxx"
 #include "timer.hxx"
+#include "upload.hxx"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include "glm/gtx/euler_angles.hpp"
@@ -33,26 +42,6 @@ namespace fs = std::filesystem;
 fs::path app_root = "/";
 
 static GLFWwindow *window = nullptr;
-extern std::array<glm::vec3, 18> const content_colors = {{
-	[0] = {1.0f, 1.0f, 1.0f}, // air
-	[1] = {0.5f, 0.5f, 0.5f}, // stone
-	[2] = {0.5f, 0.2f, 0.1f}, // dirt
-	[3] = {0.2f, 0.6f, 0.0f}, // dirt_with_grass
-	[4] = {0.9f, 0.8f, 0.6f}, // sand
-	[5] = {0.3f, 0.4f, 0.9f}, // water_source
-	[6] = {0.9f, 0.6f, 0.0f}, // lava_source
-	[7] = {0.3f, 0.3f, 0.3f}, // gravel
-	[8] = {0.0f, 0.0f, 0.0f}, // desert_stone
-	[9] = {0.0f, 0.0f, 0.0f}, // desert_sand
-	[10] = {0.7f, 0.8f, 0.9f}, // dirt_with_snow
-	[11] = {0.0f, 0.0f, 0.0f}, // snow
-	[12] = {0.8f, 0.9f, 1.0f}, // snowblock
-	[13] = {0.6f, 0.7f, 1.0f}, // ice
-	[14] = {0.0f, 0.0f, 0.0f}, // cobble
-	[15] = {0.0f, 0.0f, 0.0f}, // mossycobble
-	[16] = {0.0f, 0.0f, 0.0f}, // stair_cobble
-	[17] = {0.0f, 0.0f, 0.0f}, // stair_desert_stone
-}};
 
 timespec mapgen_time = {0, 0};
 timespec meshgen_time = {0, 0};
@@ -64,6 +53,8 @@ static float pitch = 0.0f;
 static bool v_sync = true;
 static bool fast = false;
 static bool mouse_control = true;
+static bool log_timings = false;
+static bool show_profile = false;
 static std::atomic<int> r, s;
 
 static Map map;
@@ -71,10 +62,14 @@ static std::atomic<bool> do_run = {true};
 
 static GLTTY tty;
 static FrameTimer timer;
+static UploadScheduler uploader;
+static PassTimer terrain_timer{"Terrain"};
+static PassTimer overlay_timer{"Overlay"};
 
-void mapgenth() {
+/// Generates the world layer by layer, up to @p max_layer inclusive.
+static void generate(unsigned max_layer) {
 	unsigned sum = 0;
-	while (sum <= 100) {
+	while (sum <= max_layer) {
 		for (int i = 0; i <= sum; i++) {
 			int j = sum - i;
 			for (int k = -1; k <= 10; k++) {
@@ -83,79 +78,58 @@ void mapgenth() {
 				map.requestBlock({i, j, k});
 			}
 		}
-		fmt::printf("Layer %d generated. Time: mapgen: %.3f s, meshgen: %.3f s; mesh size: %d quads\n", sum, to_double(mapgen_time), to_double(meshgen_time), mesh_size);
+		fmt::printf("Layer %d generated. Time: mapgen: %.3f s, meshgen: %.3f s; mesh size: %d quads; noise cache hits: %.0f%%\n", sum, to_double(mapgen_time), to_double(meshgen_time), mesh_size, 100.0f * map.noiseCache().hitRate());
 		r = sum;
 		s = map.size();
 		sum++;
 		mapgen_time = {0, 0};
 		meshgen_time = {0, 0};
+		map.noiseCache().resetStats();
+		// keeps the rings from filling up when nothing else collects, as while benchmarking
+		g_profiler->collect();
 	}
 }
 
+void mapgenth() {
+	g_profiler->setThreadName("Mapgen");
+	generate(100);
+}
+
 unsigned nodeTexture = 0;
 
-void loadTextures() {
-	static constexpr auto extensions = {"png", "jpg"};
-	static constexpr auto mip_levels = 10;
-	static constexpr auto texture_size = 1 << (mip_levels - 1);
-	static constexpr auto type_count = 16;
-	fn.CreateTextures(GL_TEXTURE_2D_ARRAY, 1, &nodeTexture);
-	fn.TextureParameteri(nodeTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	fn.TextureParameteri(nodeTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-	fn.TextureStorage3D(nodeTexture, mip_levels, GL_RGBA8, texture_size, texture_size, type_count);
-	for (int k = 1; k < type_count; k++) {
-		SDL_Surface *image = nullptr;
-		for (auto &&ext: extensions) {
-			auto filename = app_root / fmt::sprintf("textures/%d.%s", k, ext);
-			image = IMG_Load(filename.c_str());
-			if (image)
-				break;
-		}
-		if (!image) {
-			fmt::printf("Can't load Image #%d: %s\n", k, SDL_GetError());
-			continue;
-		}
-		if (int err = SDL_LockSurface(image); err) {
-			fmt::printf("Can't lock surface of image #%d: %s\n", k, SDL_GetError());
-			continue;
-		}
-		if (image->w != texture_size || image->h != texture_size) {
-			fmt::printf("Wrong image #%d size: %dx%d instead of %d^2\n", k, image->w, image->h, texture_size);
-			goto unlock;
-		}
-		switch (image->format->BitsPerPixel) {
-			case 24:
-				fn.TextureSubImage3D(nodeTexture, 0, 0, 0, k, texture_size, texture_size, 1, GL_RGB, GL_UNSIGNED_BYTE, image->pixels);
-				break;
-			case 32:
-				fn.TextureSubImage3D(nodeTexture, 0, 0, 0, k, texture_size, texture_size, 1, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
-				break;
-			default:
-				fmt::printf("Unsupported image #%d BPP: %d\n", k, image->format->BitsPerPixel);
-				goto unlock;
-		}
-	unlock:
-		SDL_UnlockSurface(image);
-		SDL_FreeSurface(image);
-	}
-	fn.GenerateTextureMipmap(nodeTexture);
-}
+static unsigned prog = 0;
+static int p_location, c_location, u_location, k_location;
+static int m_location, t_location;
+static unsigned vao = 0;
+static std::vector<Mesh const *> new_meshes;
 
-void run() {
+static void init_renderer() {
 	auto vert_shader = read_file(app_root / "shaders/land.vert");
 	auto frag_shader = read_file(app_root / "shaders/land.frag");
-	auto prog = link_program({
+	prog = link_program({
 		compile_shader(GL_VERTEX_SHADER, vert_shader),
 		compile_shader(GL_FRAGMENT_SHADER, frag_shader),
 	});
-	int p_location =  fn.GetAttribLocation(prog, "position");
-	int c_location =  fn.GetAttribLocation(prog, "color");
-	int u_location =  fn.GetAttribLocation(prog, "uv");
-	int k_location =  fn.GetAttribLocation(prog, "type");
-	int m_location = fn.GetUniformLocation(prog, "m");
-	int t_location = fn.GetUniformLocation(prog, "tex");
+	p_location =  fn.GetAttribLocation(prog, "position");
+	c_location =  fn.GetAttribLocation(prog, "color");
+	u_location =  fn.GetAttribLocation(prog, "uv");
+	k_location =  fn.GetAttribLocation(prog, "type");
+	m_location = fn.GetUniformLocation(prog, "m");
+	t_location = fn.GetUniformLocation(prog, "tex");
 
-	loadTextures();
+	// All meshes share the layout, so it is set up once; a draw only
+	// needs the vertex buffer binding changed, and only across arena pages.
+	fn.CreateVertexArrays(1, &vao);
+	fn.VertexArrayAttribFormat(vao, p_location, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+	fn.VertexArrayAttribFormat(vao, c_location, 4, GL_FLOAT, GL_FALSE, offsetof(Vertex, color));
+	fn.VertexArrayAttribIFormat(vao, k_location, 1, GL_UNSIGNED_INT, offsetof(Vertex, type));
+	fn.VertexArrayAttribFormat(vao, u_location, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, uv));
+	for (int location: {p_location, c_location, k_location, u_location}) {
+		fn.VertexArrayAttribBinding(vao, location, 0);
+		fn.EnableVertexArrayAttrib(vao, location);
+	}
+
+	nodeTexture = loadNodeTextures(app_root, app_root / "textures.cache");
 
 	fn.ClearColor(0.2, 0.1, 0.3, 1.0);
 	int max_v, max_i;
@@ -164,12 +138,81 @@ void run() {
 	fmt::printf("Vertex limit: %d\nIndex limit: %d\n", max_v, max_i);
 
 	tty.init();
+	terrain_timer.init();
+	overlay_timer.init();
+}
+
+/// Clears the framebuffer, uploads what fits into this frame and draws all
+/// the terrain uploaded so far.
+static FrameStats render_world(glm::vec3 eye_pos, float yaw, float pitch, float aspect) {
+	glm::mat4 m_view = glm::translate(glm::eulerAngleXZ(pitch, yaw), -eye_pos);
+	glm::mat4 m_proj = glm::infinitePerspective(glm::radians(60.f), aspect, .1f);
+	m_proj[2] = -m_proj[2];
+	std::swap(m_proj[1], m_proj[2]);
+	glm::mat4 m_render = m_proj * m_view;
+
+	fn.Disable(GL_BLEND);
+	fn.Enable(GL_DEPTH_TEST);
+	fn.Enable(GL_CULL_FACE);
+	fn.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	fn.UseProgram(prog);
+	fn.UniformMatrix4fv(m_location, 1, GL_FALSE, &m_render[0][0]);
+	fn.Uniform1i(t_location, 0);
+	fn.BindTextureUnit(0, nodeTexture);
+	fn.BindVertexArray(vao);
+	new_meshes.clear();
+	map.tryGetMeshes(new_meshes, eye_pos, 200.f);
+	for (Mesh const *mesh: new_meshes)
+		uploader.enqueue(mesh);
+	uploader.upload(eye_pos);
+
+	FrameStats stats;
+	stats.upload_bytes = uploader.frame_bytes();
+	unsigned bound_buffer = 0;
+	for (GpuMesh const &mesh: uploader.ready()) {
+		if (mesh.buffer != bound_buffer) {
+			fn.VertexArrayVertexBuffer(vao, 0, mesh.buffer, 0, sizeof(Vertex));
+			bound_buffer = mesh.buffer;
+		}
+		fn.DrawArrays(GL_QUADS, mesh.first, mesh.vertex_count);
+		stats.draws++;
+		stats.vertices += mesh.vertex_count;
+	}
+	return stats;
+}
+
+static void render_overlay() {
+	fn.Disable(GL_DEPTH_TEST);
+	fn.Enable(GL_BLEND);
+	fn.BlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	tty.render();
+}
+
+static void print_pass_timings(PassTimer const &pass) {
+	tty.println("{}: CPU {:.2f} ms avg, {:.2f} max; GPU {:.2f} ms avg, {:.2f} max", pass.name,
+		1e3f * pass.cpu.average(), 1e3f * pass.cpu.maximum(),
+		1e3f * pass.gpu.average(), 1e3f * pass.gpu.maximum());
+}
+
+/// Zones of all threads together, as many as fit below the other lines
+static void print_profile() {
+	tty.println("{:<36} {:>7} {:>8} {:>8} {:>8}", "Zone", "Count", "Min ms", "Mean ms", "P99 ms");
+	for (auto const &zone: g_profiler->stats(false)) {
+		if (tty.cursor().y + 1 >= TTY::height)
+			break;
+		ProfilerHistogram const &h = zone.histogram;
+		tty.println("{:<36.36} {:>7} {:>8.3f} {:>8.3f} {:>8.3f}", zone.zone, h.count,
+			1e-6 * h.min, 1e-6 * h.mean(), 1e-6 * h.percentile(0.99));
+	}
+}
+
+void run() {
+	init_renderer();
 
 	glm::vec3 pos{0.f, 0.f, level};
 	if (level >= 10000)
 		pos = {44.f, -6.f, 41.f};
-	std::vector<Mesh const *> meshes;
-	std::unordered_map<Mesh const *, unsigned> buffers;
+	double last_log = 0.0;
 	timer.start();
 	while (!glfwWindowShouldClose(window)) {
 		if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -178,6 +221,7 @@ void run() {
 
 		tty.clear();
 		tty.println("FPS: {:.0f} (v-sync {})", timer.fps(), v_sync ? "enabled" : "disabled");
+		tty.println("Frame time: {:.1f} ms p50, {:.1f} ms p99", 1e3f * timer.p50(), 1e3f * timer.p99());
 		tty.println("Position: {:.1f}, {:.1f}, {:.1f}", pos.x, pos.y, pos.z);
 		tty.println("Mouse control: {}", mouse_control ? "enabled" : "disabled");
 
@@ -203,51 +247,122 @@ void run() {
 		float aspect = 1.f * w / h;
 		float eye_level = 1.75f;
 		glm::vec3 eye_pos = pos + glm::vec3{0.0f, 0.0f, eye_level};
-		glm::mat4 m_view = glm::translate(glm::eulerAngleXZ(pitch, yaw), -eye_pos);
-		glm::mat4 m_proj = glm::infinitePerspective(glm::radians(60.f), aspect, .1f);
-		m_proj[2] = -m_proj[2];
-		std::swap(m_proj[1], m_proj[2]);
-		glm::mat4 m_render = m_proj * m_view;
-
-		fn.Disable(GL_BLEND);
-		fn.Enable(GL_DEPTH_TEST);
-		fn.Enable(GL_CULL_FACE);
-		fn.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		fn.UseProgram(prog);
-		fn.UniformMatrix4fv(m_location, 1, GL_FALSE, &m_render[0][0]);
-		fn.Uniform1i(t_location, 0);
-		fn.BindTextureUnit(0, nodeTexture);
-		fn.EnableVertexAttribArray(p_location);
-		fn.EnableVertexAttribArray(c_location);
-		fn.EnableVertexAttribArray(k_location);
-		fn.EnableVertexAttribArray(u_location);
-		map.tryGetMeshes(meshes, eye_pos, 200.f);
-		for (Mesh const *mesh: meshes) {
-			auto &buf = buffers[mesh];
-			if (!buf) {
-				fn.CreateBuffers(1, &buf);
-				fn.NamedBufferStorage(buf, sizeof(Vertex) * mesh->vertices.size(), mesh->vertices.data(), 0);
-			}
-			fn.BindBuffer(GL_ARRAY_BUFFER, buf);
-			fn.VertexAttribPointer(p_location, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, position)));
-			fn.VertexAttribPointer(c_location, 4, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, color)));
-			fn.VertexAttribIPointer(k_location, 1, GL_UNSIGNED_INT, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, type)));
-			fn.VertexAttribPointer(u_location, 2, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, uv)));
-			fn.DrawArrays(GL_QUADS, 0, mesh->vertices.size());
-		}
+		terrain_timer.begin();
+		render_world(eye_pos, yaw, pitch, aspect);
+		terrain_timer.end();
 
-		tty.println("{} blocks, {} meshes, distance up to {}", s, meshes.size(), r * block_size);
-
-		fn.Disable(GL_DEPTH_TEST);
-		fn.Enable(GL_BLEND);
-		fn.BlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-		tty.render();
+		tty.println("{} blocks, {} meshes, distance up to {}", s, uploader.ready().size(), r * block_size);
+		tty.println("Uploads: {} KiB in {} meshes, {} meshes ({} KiB) pending, {} arena pages",
+			uploader.frame_bytes() >> 10, uploader.frame_uploads(),
+			uploader.pending(), uploader.pending_bytes() >> 10, uploader.page_count());
+		print_pass_timings(terrain_timer);
+		print_pass_timings(overlay_timer);
+		g_profiler->collect();
+		if (show_profile)
+			print_profile();
+		if (log_timings && timer.t() - last_log >= 1.0) {
+			last_log = timer.t();
+			terrain_timer.log();
+			overlay_timer.log();
+		}
+		overlay_timer.begin();
+		render_overlay();
+		overlay_timer.end();
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 }
 
+struct BenchmarkOptions {
+	fs::path output; ///< Empty if not benchmarking
+	int frames = 600;
+	unsigned layers = 16;
+	int width = 1280;
+	int height = 720;
+	bool osmesa = false;
+};
+
+/// Renders a fixed camera path over a pre-generated world into an offscreen
+/// framebuffer, so that the results don’t depend on the window system.
+static void run_benchmark(BenchmarkOptions const &opts) {
+	generate(opts.layers);
+	init_renderer();
+
+	unsigned fb, color, depth;
+	fn.CreateFramebuffers(1, &fb);
+	fn.CreateRenderbuffers(1, &color);
+	fn.CreateRenderbuffers(1, &depth);
+	fn.NamedRenderbufferStorage(color, GL_RGBA8, opts.width, opts.height);
+	fn.NamedRenderbufferStorage(depth, GL_DEPTH_COMPONENT16, opts.width, opts.height);
+	fn.NamedFramebufferRenderbuffer(fb, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	fn.NamedFramebufferRenderbuffer(fb, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	if (fn.CheckNamedFramebufferStatus(fb, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		throw std::runtime_error("Offscreen framebuffer is incomplete");
+	fn.BindFramebuffer(GL_FRAMEBUFFER, fb);
+	fn.Viewport(0, 0, opts.width, opts.height);
+
+	float extent = opts.layers * block_size;
+	float ground = level < 10000 ? level : 41.f;
+	glm::vec3 center{extent / 3.f, extent / 3.f, ground + 30.f};
+	float aspect = 1.f * opts.width / opts.height;
+	BenchmarkLog log;
+	for (int frame = 0; frame < opts.frames; frame++) {
+		CameraPose camera = benchmark_camera(frame, opts.frames, center, extent / 6.f);
+		auto wall0 = std::chrono::steady_clock::now();
+		timespec cpu0 = thread_cpu_clock();
+		terrain_timer.begin();
+		FrameStats stats = render_world(camera.eye_pos, camera.yaw, camera.pitch, aspect);
+		terrain_timer.end();
+		tty.clear();
+		tty.println("Benchmark: frame {} of {}", frame + 1, opts.frames);
+		tty.println("{} meshes, {} meshes pending", uploader.ready().size(), uploader.pending());
+		overlay_timer.begin();
+		render_overlay();
+		overlay_timer.end();
+		timespec cpu1 = thread_cpu_clock();
+		fn.Finish();
+		auto wall1 = std::chrono::steady_clock::now();
+		// the frame is finished, so its queries are ready
+		terrain_timer.collect();
+		overlay_timer.collect();
+		log.add({
+			to_double(cpu1 - cpu0),
+			std::chrono::duration<double>(wall1 - wall0).count(),
+			terrain_timer.gpu.last(),
+			overlay_timer.gpu.last(),
+			stats,
+		});
+	}
+	terrain_timer.log();
+	overlay_timer.log();
+
+	fn.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	fn.DeleteFramebuffers(1, &fb);
+	fn.DeleteRenderbuffers(1, &color);
+	fn.DeleteRenderbuffers(1, &depth);
+
+	log.write(opts.output);
+	log.print_summary();
+	fmt::printf("Benchmark results written to %s\n", opts.output.native());
+}
+
+/// Writes the collected zones to @p path, as stats or as a Chrome trace.
+static void write_profile(fs::path const &path, bool trace) {
+	g_profiler->collect();
+	std::FILE *file = std::fopen(path.c_str(), "w");
+	if (!file) {
+		fprintf(stderr, "Can't write profile to %s\n", path.c_str());
+		return;
+	}
+	if (trace)
+		g_profiler->writeTrace(file);
+	else
+		g_profiler->writeJson(file);
+	std::fclose(file);
+	fmt::printf("Profile written to %s\n", path.native());
+}
+
 static void on_mouse_move(GLFWwindow *window, double xpos, double ypos) {
 	static bool is_okay = false;
 	static glm::vec2 base_pos;
@@ -279,6 +394,12 @@ static void on_key(GLFWwindow *window, int key, int scancode, int action, int mo
 		case GLFW_KEY_J:
 			fast = !fast;
 			break;
+		case GLFW_KEY_L:
+			log_timings = !log_timings;
+			break;
+		case GLFW_KEY_P:
+			show_profile = !show_profile;
+			break;
 		case GLFW_KEY_M:
 		case GLFW_KEY_TAB:
 			mouse_control = !mouse_control;
@@ -293,7 +414,56 @@ int main(int argc, char **argv) {
 	if (self.has_parent_path())
 		app_root = self.parent_path().parent_path();
 	fmt::printf("Root: %s\n", app_root.native());
+	BenchmarkOptions bench;
+	std::string_view mapgen = "v6";
+	int chunk_size = 5;
+	fs::path profile_output, trace_output;
+	for (int k = 1; k < argc; k++) {
+		std::string_view arg = argv[k];
+		if (arg == "--benchmark" && k + 1 < argc)
+			bench.output = argv[++k];
+		else if (arg == "--frames" && k + 1 < argc)
+			bench.frames = std::max(1, std::atoi(argv[++k]));
+		else if (arg == "--layers" && k + 1 < argc)
+			bench.layers = std::max(1, std::atoi(argv[++k]));
+		else if (arg == "--osmesa") {
+#ifdef GLFW_PLATFORM_NULL
+			bench.osmesa = true;
+#else
+			fprintf(stderr, "--osmesa needs GLFW 3.4 or later\n");
+			return EXIT_FAILURE;
+#endif
+		}
+		else if (arg == "--mapgen" && k + 1 < argc)
+			mapgen = argv[++k];
+		else if (arg == "--chunk-size" && k + 1 < argc)
+			chunk_size = std::clamp(std::atoi(argv[++k]), 1, 16);
+		else if (arg == "--profile" && k + 1 < argc)
+			profile_output = argv[++k];
+		else if (arg == "--trace" && k + 1 < argc)
+			trace_output = argv[++k];
+		else {
+			fprintf(stderr, "Usage: %s [--mapgen v6|heightmap] [--chunk-size BLOCKS] [--profile stats.json] [--trace trace.json] [--benchmark <output.csv|output.json> [--frames N] [--layers N] [--osmesa]]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (mapgen == "v6")
+		map.setMapgen(std::make_unique<MinetestMapgenV6>(666, chunk_size, &map.noiseCache()));
+	else if (mapgen == "heightmap")
+		map.setMapgen(std::make_unique<HeightmapMapgen>(fractal_heightmap(666), 1, 3, chunk_size));
+	else {
+		fprintf(stderr, "Unknown map generator: %s\n", mapgen.data());
+		return EXIT_FAILURE;
+	}
+	g_profiler->setThreadName("Main");
+	if (!trace_output.empty())
+		g_profiler->setTraceCapacity(1 << 20);
+	bool benchmark = !bench.output.empty();
 	int result = EXIT_FAILURE;
+#ifdef GLFW_PLATFORM_NULL
+	if (bench.osmesa) // no display server needed at all
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
 	if (!glfwInit()) {
 		fprintf(stderr, "Can't initialize GLFW");
 		goto err_early;
@@ -307,35 +477,55 @@ int main(int argc, char **argv) {
 	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
 	glfwWindowHint(GLFW_DEPTH_BITS, 16);
 	glfwWindowHint(GLFW_SAMPLES, 4);
+	if (benchmark) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		if (bench.osmesa)
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	}
 	window = glfwCreateWindow(800, 600, "V_CORE", NULL, NULL);
 	if (!window) {
 		fprintf(stderr, "Can't create window");
 		goto err_after_glfw;
 	}
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	if (!benchmark) {
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 #ifdef GLFW_RAW_MOUSE_MOTION
-	glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+		glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
 #endif
-	glfwSetCursorPosCallback(window, on_mouse_move);
-	glfwSetKeyCallback(window, on_key);
+		glfwSetCursorPosCallback(window, on_mouse_move);
+		glfwSetKeyCallback(window, on_key);
+	}
 
 	glfwMakeContextCurrent(window);
 	loadAll(glfwGetProcAddress);
 
-	map.requestBlock({0, 0, 0});
-	{
-	std::thread th(mapgenth);
-	try {
-		run();
-		result = EXIT_SUCCESS;
-	} catch(std::exception const &e) {
-		fprintf(stderr, "Exception caught of class %s with message:\n%s\n", typeid(e).name(), e.what());
-	} catch(...) {
-		fprintf(stderr, "Invalid exception caught\n");
-	}
-	do_run = false;
-	th.join();
+	map.requestBlock({0, 0, 0}, true);
+	if (benchmark) {
+		try {
+			run_benchmark(bench);
+			result = EXIT_SUCCESS;
+		} catch(std::exception const &e) {
+			fprintf(stderr, "Exception caught of class %s with message:\n%s\n", typeid(e).name(), e.what());
+		} catch(...) {
+			fprintf(stderr, "Invalid exception caught\n");
+		}
+	} else {
+		std::thread th(mapgenth);
+		try {
+			run();
+			result = EXIT_SUCCESS;
+		} catch(std::exception const &e) {
+			fprintf(stderr, "Exception caught of class %s with message:\n%s\n", typeid(e).name(), e.what());
+		} catch(...) {
+			fprintf(stderr, "Invalid exception caught\n");
+		}
+		do_run = false;
+		th.join();
 	}
+	if (!profile_output.empty())
+		write_profile(profile_output, false);
+	if (!trace_output.empty())
+		write_profile(trace_output, true);
 
 err_after_window:
 	glfwDestroyWindow(window);
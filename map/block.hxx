@@ -16,9 +16,14 @@ static constexpr int block_data_size = block_size * block_size * block_size;
 static constexpr content_t CONTENT_IGNORE = (content_t)-1;
 static constexpr content_t CONTENT_AIR = 0;
 
+/// Light levels of one bank of Qube::light. Only sunlight is brighter than
+/// LIGHT_MAX.
+static constexpr param_t LIGHT_MAX = 14;
+static constexpr param_t LIGHT_SUN = 15;
+
 struct Qube {
 	content_t content = CONTENT_IGNORE;
-	param_t light = 0x00;
+	param_t light = 0x00; ///< day light in the low 4 bits, night light in the high ones
 	param_t param = 0x00;
 };
 
@@ -1,9 +1,12 @@
 #include "map.hxx"
+#include <algorithm>
+#include <iterator>
 #include <fmt/printf.h>
 #include "time.hxx"
 #include <meshgen/slicing.hxx>
 #include <meshgen/meshing.hxx>
-#include <mapgen/minetest/v6/mapgen_v6.hxx>
+#include <mapgen/minetest_v6.hxx>
+#include <mapgen/minetest/common/profiler.hxx>
 
 extern timespec mapgen_time;
 extern timespec meshgen_time;
@@ -34,8 +37,12 @@ void Map::generateMesh(glm::ivec3 blockpos) {
 
 	timespec t0 = thread_cpu_clock();
 	auto pos = MAP_BLOCKSIZE * blockpos;
+	std::uint64_t p0 = Profiler::now();
 	auto slices0 = make_slices(vm, blockpos);
+	std::uint64_t p1 = Profiler::now();
 	auto mesh0 = make_mesh(slices0, pos);
+	g_profiler->record("Meshgen: make_slices", p0, p1);
+	g_profiler->record("Meshgen: make_mesh", p1, Profiler::now());
 	if (mesh0->vertices.empty())
 		return; // don’t need to store it
 	timespec t1 = thread_cpu_clock();
@@ -69,6 +76,50 @@ void Map::pushBlock(std::unique_ptr<Block> block) {
 	mblock.content = std::move(block);
 }
 
+static bool in_chunk(glm::ivec3 pos, glm::ivec3 base, int size) {
+	pos -= base;
+	return
+		pos.x >= 0 && pos.x < size &&
+		pos.y >= 0 && pos.y < size &&
+		pos.z >= 0 && pos.z < size;
+}
+
+/// Fills @p vm for the generation of the chunk of @p size blocks at @p base:
+/// the padding with the blocks generated so far, the rest with what the
+/// chunks around wrote there.
+void Map::loadChunkArea(MMVManip &vm, glm::ivec3 base, int size) {
+	for (auto pos: space_range{vm.bstart, vm.bstart + vm.bsize}) {
+		auto it = data.find(pos);
+		if (!in_chunk(pos, base, size) && it != data.end() && it->second.content) {
+			vm.getBlock(pos) = *it->second.content;
+			continue;
+		}
+		auto pending = overhang.find(pos);
+		if (pending == overhang.end())
+			continue;
+		vm.getBlock(pos) = *pending->second;
+		overhang.erase(pending);
+	}
+}
+
+/// Keeps what the generator wrote to the padding of @p vm. The blocks next
+/// to the faces of the chunk cannot be meshed yet, but those along its edges
+/// may be, and keep the mesh they have.
+void Map::storePadding(MMVManip &vm, glm::ivec3 base, int size) {
+	for (auto pos: space_range{vm.bstart, vm.bstart + vm.bsize}) {
+		if (in_chunk(pos, base, size))
+			continue;
+		auto it = data.find(pos);
+		if (it != data.end() && it->second.content) {
+			it->second.content = vm.takeBlock(pos);
+			continue;
+		}
+		Block const &block = vm.getBlock(pos);
+		if (std::any_of(std::begin(block.qube), std::end(block.qube), [] (Qube const &q) { return q.content != CONTENT_IGNORE; }))
+			overhang[pos] = vm.takeBlock(pos);
+	}
+}
+
 inline static long round_to(long value, unsigned step, unsigned bias) {
 	if (bias > step)
 		throw std::invalid_argument("Rounding bias is insanely large");
@@ -79,38 +130,18 @@ inline static long round_to(long value, unsigned step) {
 	return round_to(value, step, 0);
 }
 
-void Map::requestBlock(glm::ivec3 blockpos) {
+void Map::requestBlock(glm::ivec3 blockpos, bool urgent) {
 	// thread-local - no locking
 	ClientMapBlock &block = data[blockpos];
 	if (block.content)
 		return; // generated already
 
-	static MapgenV6Params params;
-	params.seed = 666;
-	static MapV6Params map_params;
-	map_params.stone = 1;
-	map_params.dirt = 2;
-	map_params.dirt_with_grass = 3;
-	map_params.sand = 4;
-	map_params.water_source = 5;
-	map_params.lava_source = 6;
-	map_params.gravel = 7;
-	map_params.desert_stone = 8;
-	map_params.desert_sand = 9;
-	map_params.dirt_with_snow = 10;
-	map_params.snow = 11;
-	map_params.snowblock = 12;
-	map_params.ice = 13;
-	map_params.cobble = 14;
-	map_params.mossycobble = 15;
-	map_params.stair_cobble = 16;
-	map_params.stair_desert_stone = 17;
-	static MapgenV6 mapgen(&params, map_params);
-
-// 	fmt::print("Ground level: {}\n", mapgen.getGroundLevelAtPoint({0, 0}));
-// 	fmt::print("Spawn level: {}\n", mapgen.getSpawnLevelAtPoint({0, 0}));
-
-	glm::ivec3 base{round_to(blockpos.x, 5, 2), round_to(blockpos.y, 5, 2), round_to(blockpos.z, 5, 2)};
+	if (!mapgen)
+		mapgen = std::make_unique<MinetestMapgenV6>(666, 5, &noise_cache);
+	int const size = mapgen->chunkSize();
+	int const padding = mapgen->chunkPadding();
+
+	glm::ivec3 base{round_to(blockpos.x, size, size / 2), round_to(blockpos.y, size, size / 2), round_to(blockpos.z, size, size / 2)};
 
 	if (data[base].content) {
 		fmt::printf("Warning: %d,%d,%d is not generated but %d,%d,%d is\n",
@@ -120,25 +151,28 @@ void Map::requestBlock(glm::ivec3 blockpos) {
 		return; // generated already
 	}
 
-	MMVManip mapfrag{base - CHUNK_PADDING_BLOCKS, base + (CHUNK_SIZE_BLOCKS + CHUNK_PADDING_BLOCKS - 1)};
-	BlockMakeData bmd;
-	bmd.seed = params.seed;
-	bmd.vmanip = &mapfrag;
-	bmd.blockpos_min = vcore_to_mt(base);
-	bmd.blockpos_max = vcore_to_mt(base + (CHUNK_SIZE_BLOCKS - 1));
-	timespec t0 = thread_cpu_clock();
-	mapgen.makeChunk(&bmd);
-	timespec t1 = thread_cpu_clock();
+	MMVManip mapfrag{base - padding, base + (size + padding - 1)};
+	loadChunkArea(mapfrag, base, size);
+	mapgen->setLatencyMode(urgent);
+	// Wall time: in latency mode the chunk is generated on the TaskPool
+	// workers, which the CPU time of this thread would miss
+	timespec t0 = monotonic_clock();
+	{
+		ScopeProfiler sp(g_profiler, "Map: generate chunk");
+		mapgen->generate(mapfrag, base);
+	}
+	timespec t1 = monotonic_clock();
 	mapgen_time = mapgen_time + (t1 - t0);
 	if (!level)
-		level = mapgen.getSpawnLevelAtPoint({0, 0});
+		level = mapgen->getSpawnLevel({0, 0});
 
 	{ // synchronizing with the main thread
 		std::lock_guard<std::mutex> guard(mtx);
-		for (auto pos: space_range{base, base + CHUNK_SIZE_BLOCKS})
+		for (auto pos: space_range{base, base + size})
 			pushBlock(mapfrag.takeBlock(pos));
 	}
-	for (auto pos: space_range{base - 1, base + CHUNK_SIZE_BLOCKS + 1})
+	storePadding(mapfrag, base, size);
+	for (auto pos: space_range{base - 1, base + size + 1})
 		generateMesh(pos);
 }
 
@@ -10,7 +10,9 @@
 #include <glm/vec3.hpp>
 #include "helpers.hxx"
 #include "mesh.hxx"
+#include "mapgen/interface.hxx"
 #include "mapgen/minetest/common/map.hxx"
+#include "mapgen/minetest/common/noise_cache.hxx"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
@@ -97,17 +99,32 @@ class Map {
 private:
 	std::unordered_map<glm::ivec3, ClientMapBlock> data;
 	mutable std::mutex mtx;
+	NoiseMapCache noise_cache;
+	std::unique_ptr<IMapgen> mapgen;
+	/// What the generator wrote to the padding where no block is generated
+	/// yet, for when it is. Only the mapgen thread uses it.
+	std::unordered_map<glm::ivec3, std::unique_ptr<Block>> overhang;
 
 	void generateMesh(glm::ivec3 blockpos);
 	void pushBlock(std::unique_ptr<Block> block);
+	void loadChunkArea(MMVManip &vm, glm::ivec3 base, int size);
+	void storePadding(MMVManip &vm, glm::ivec3 base, int size);
 
 	void getMeshesUnlocked(std::vector<Mesh const *> &to, glm::vec3 pos, float mip_range) const;
 
 public:
-	void requestBlock(glm::ivec3 blockpos);
+	/// Replaces the map generator. Only valid before any block is requested.
+	void setMapgen(std::unique_ptr<IMapgen> _mapgen) { mapgen = std::move(_mapgen); }
+
+	/// Generates the chunk containing @p blockpos, unless it is there already.
+	/// Uses mapgen v6 if no generator was set. @p urgent chunks are generated
+	/// in the latency mode (see IMapgen::setLatencyMode).
+	void requestBlock(glm::ivec3 blockpos, bool urgent = false);
 
 	std::vector<Mesh const *> getMeshes(glm::vec3 pos, float mip_range) const;
 	bool tryGetMeshes(std::vector<Mesh const *> &to, glm::vec3 pos, float mip_range) const;
 
 	std::size_t size() const { return data.size(); }
+
+	NoiseMapCache &noiseCache() { return noise_cache; }
 };
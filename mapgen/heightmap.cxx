@@ -1,28 +1,81 @@
 #include "heightmap.hxx"
-#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "mapgen/minetest/common/map.hxx"
+#include "util/perlin.hxx"
 
-HeightmapMapgen::HeightmapMapgen(HeightmapFn _f, QubeType _solid) :
-	f(_f), solid(_solid)
+HeightmapMapgen::HeightmapMapgen(HeightmapFn _f, content_t _solid, content_t _surface, int _chunk_size) :
+	f(std::move(_f)), solid(_solid), surface(_surface), chunk_size(_chunk_size)
 {
 }
 
-Block HeightmapMapgen::generate(BlockPosition block_pos)
+int HeightmapMapgen::chunkSize() const
 {
-	Block block;
-	std::memset(&block, 0, sizeof(block));
-	for (int i = 0; i < block_size; i++)
-		for (int j = 0; j < block_size; j++) {
-			int x = block_size * block_pos.x + i;
-			int y = block_size * block_pos.y + j;
-			int z_bottom = block_size * block_pos.z;
-			int z_top = f(x, y);
-			int h = z_top - z_bottom;
-			if (h <= 0)
+	return chunk_size;
+}
+
+void HeightmapMapgen::generate(MMVManip &vm, BlockPos base)
+{
+	int const side = chunk_size * block_size;
+	std::vector<long> heights(side * side);
+	f(heights.data(), block_size * glm::ivec2{base.x, base.y}, {side, side});
+
+	// There are no overhangs, so all the air is in the sun
+	Qube const air{CONTENT_AIR, LIGHT_SUN};
+	Qube const body{solid};
+	Qube const top{surface};
+	for (int bx = 0; bx < chunk_size; bx++)
+	for (int by = 0; by < chunk_size; by++)
+	for (int bz = 0; bz < chunk_size; bz++) {
+		Block &block = vm.getBlock(base + glm::ivec3{bx, by, bz});
+		long bottom = block_size * (base.z + bz);
+		for (int x = 0; x < block_size; x++)
+		for (int y = 0; y < block_size; y++) {
+			long height = heights[(block_size * bx + x) + side * (block_size * by + y)];
+			// qubes below `height` are solid, the one just below it is the surface
+			int h = std::clamp<long>(height - bottom, 0, block_size);
+			Qube *column = &block.qube[Block::index_unsafe({x, y, 0})];
+			if (h == 0) {
+				std::fill_n(column, block_size, air);
 				continue;
-			if (h > block_size)
-				h = block_size;
-			for (int k = 0; k < h; k++)
-				block.qube[Block::index(i, j, k)] = solid;
+			}
+			bool has_top = height - bottom <= block_size;
+			std::fill_n(column, has_top ? h - 1 : h, body);
+			if (has_top)
+				column[h - 1] = top;
+			std::fill_n(column + h, block_size - h, air);
+		}
+	}
+}
+
+int HeightmapMapgen::getSpawnLevel(glm::ivec2 column)
+{
+	long height;
+	f(&height, column, {1, 1});
+	return height;
+}
+
+HeightmapFn fractal_heightmap(int seed, long extent, long level, float amplitude)
+{
+	constexpr float cell = 512.0f;
+	constexpr int octaves = 4;
+	auto noise = std::make_shared<FractalNoise2d>(extent, extent, cell, octaves);
+	noise->generate(seed);
+	return [=] (long *heights, glm::ivec2 origin, glm::ivec2 size) {
+		long const half = extent / 2;
+		long const count = long(size.x) * size.y;
+		bool inside =
+			origin.x >= -half && origin.x + size.x <= half &&
+			origin.y >= -half && origin.y + size.y <= half;
+		if (!inside) {
+			std::fill_n(heights, count, level);
+			return;
 		}
-	return block;
+		std::vector<float> values(count);
+		noise->get(values.data(), size, glm::vec2(origin.x + half, origin.y + half), {1.0f, 1.0f});
+		for (long k = 0; k < count; k++)
+			heights[k] = level + std::lround(amplitude * values[k]);
+	};
 }
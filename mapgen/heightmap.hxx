@@ -1,24 +1,38 @@
 #pragma once
 #include <functional>
+#include <glm/vec2.hpp>
 #include "interface.hxx"
 
-/// Function returning terrain height at given coordinates. All values are in qubes here.
-using HeightmapFn = std::function<long(long x, long y)>;
+/// Function filling @p heights with the terrain height of @p size.x × @p size.y
+/// qube columns, x fastest, the first one being @p origin. All values are in qubes here.
+using HeightmapFn = std::function<void(long *heights, glm::ivec2 origin, glm::ivec2 size)>;
 
 /// Basic map generator. Solidifies a height map (in form of @c HeightmapFn).
-/// @note Stateless (and thus thread-safe).
+/// The height map is evaluated once per column of a chunk, and each column of
+/// a block is then filled with at most three spans (solid, surface, air).
+/// Meant as a cheap generator to load the meshing and rendering with.
 class HeightmapMapgen: public IMapgen {
 public:
-	QubeType const air = 0;
-	QubeType const solid = 1;
 	HeightmapFn const f;
+	content_t const solid;
+	content_t const surface;
+	int const chunk_size;
 
 	/// Creates a map generator.
-	/// @param _f Should return the height map, point by point.
+	/// @param _f Should return the height map, a chunk worth of columns at once.
 	/// @param _solid Qube to use to fill the terrain body. Is placed everywhere
 	/// below the level @p _f returns.
-	HeightmapMapgen(HeightmapFn _f, QubeType _solid = 1);
+	/// @param _surface Qube to place at the top of each column instead.
+	/// @param _chunk_size See IMapgen::chunkSize.
+	HeightmapMapgen(HeightmapFn _f, content_t _solid = 1, content_t _surface = 3, int _chunk_size = 5);
 
-	Block generate(BlockPosition block_pos) override;
-private:
+	int chunkSize() const override;
+	void generate(MMVManip &vm, BlockPos base) override;
+	int getSpawnLevel(glm::ivec2 column) override;
 };
+
+/// Rolling hills of fractal noise (see util/perlin.hxx), @p amplitude qubes
+/// high around @p level. The noise has a finite domain, so it covers only a
+/// square of @p extent qubes centered at the origin; outside it, the terrain
+/// is flat at @p level.
+HeightmapFn fractal_heightmap(int seed, long extent = 32768, long level = 0, float amplitude = 64.0f);
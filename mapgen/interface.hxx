@@ -1,8 +1,41 @@
 #pragma once
-#include "map/block.hxx"
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <map/helpers.hxx>
+#include <map/block.hxx>
 
+class MMVManip;
+
+/// Map generator interface. Generates the world a chunk (a cube of blocks)
+/// at a time; @c Map decides which chunks to generate and owns the result.
+/// @note Implementations are not required to be thread-safe.
 class IMapgen {
 public:
 	virtual ~IMapgen() = default;
-	virtual Block generate(BlockPosition block_pos) = 0;
+
+	/// Chunk edge length, in blocks. Chunks are aligned so that the one at
+	/// the origin is centered: chunk @c n starts at `n * size - size / 2`.
+	virtual int chunkSize() const = 0;
+
+	/// Blocks around the chunk the generator may also write to.
+	virtual int chunkPadding() const { return 0; }
+
+	/// Generates the chunk starting at block @p base into @p vm, which spans
+	/// the chunk and its padding. Every qube of the chunk must be set.
+	/// The padding holds the blocks generated so far, and CONTENT_IGNORE
+	/// elsewhere; the chunk holds what the chunks around wrote into it.
+	/// Whatever is written to the padding is kept.
+	virtual void generate(MMVManip &vm, BlockPos base) = 0;
+
+	/// In latency mode, the generator may use several threads for each chunk
+	/// to have it sooner, e.g. when the player waits for it. The generated
+	/// world must be the same either way.
+	virtual void setLatencyMode(bool enable) {}
+
+	/// Height to place the player at, over the qube column @p column.
+	/// Returns 10000 or more if there is no suitable place.
+	virtual int getSpawnLevel(glm::ivec2 column) = 0;
 };
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <functional>
@@ -109,6 +110,33 @@ public:
 		return block.qube[Block::index_unsafe(rqube)];
 	}
 
+	/// Qubes from @p pos up (along MT Y, which is vcore Z) to the top of its
+	/// block. These are contiguous, so a column can be walked with one block
+	/// lookup per span instead of one per qube.
+	struct Span {
+		Qube *begin;
+		int size;
+	};
+
+	Span column_rw(glm::ivec3 pos) {
+		auto [vblock, rqube] = split(mt_to_vcore(pos));
+		auto &&block = getBlock(vblock);
+		return {&block.qube[Block::index_unsafe(rqube)], MAP_BLOCKSIZE - rqube.z};
+	}
+
+	/// Writes the @p count qubes from @p pos up a span at a time, calling
+	/// `fn(dest, k, size)` for the `size` qubes from `dest`, which is @p k
+	/// qubes above @p pos. All of them must be in the manip.
+	template <typename F>
+	void write_column(glm::ivec3 pos, int count, F &&fn) {
+		for (int k = 0; k < count; ) {
+			Span span = column_rw(pos + glm::ivec3{0, k, 0});
+			int size = std::min(span.size, count - k);
+			fn(span.begin, k, size);
+			k += size;
+		}
+	}
+
 	Qube get_ign(glm::ivec3 pos) {
 		auto [vblock, rqube] = split(mt_to_vcore(pos));
 		if (!in_manip(vblock))
@@ -125,3 +153,15 @@ using MapBlock = Block;
 inline static bool is_walkable(content_t content) { // FIXME: stub
 	return content != CONTENT_AIR && content != CONTENT_IGNORE;
 }
+
+inline static bool light_propagates(content_t content) { // FIXME: stub
+	return content == CONTENT_AIR;
+}
+
+inline static bool sunlight_propagates(content_t content) { // FIXME: stub
+	return content == CONTENT_AIR;
+}
+
+inline static param_t light_source(content_t content) { // FIXME: stub
+	return 0;
+}
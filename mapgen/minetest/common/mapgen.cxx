@@ -21,8 +21,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapgen.hxx"
 
+#include <algorithm>
 #include <cmath>
+#include <iterator>
 #include "map.hxx"
+#include "profiler.hxx"
 // #include "voxel.h"
 // #include "noise.h"
 // #include "gamedef.h"
@@ -35,7 +38,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // #include "emerge.h"
 // #include "voxelalgorithms.h"
 // #include "porting.h"
-// #include "profiler.h"
 // #include "settings.h"
 // #include "treegen.h"
 // #include "serialization.h"
@@ -198,7 +200,7 @@ void Mapgen::updateHeightmap(v3s16 nmin, v3s16 nmax)
 	if (!heightmap)
 		return;
 
-	//TimeTaker t("Mapgen::updateHeightmap", NULL, PRECISION_MICRO);
+	ScopeProfiler sp(g_profiler, "Mapgen: updateHeightmap");
 	int index = 0;
 	for (s16 z = nmin.z; z <= nmax.z; z++) {
 		for (s16 x = nmin.x; x <= nmax.x; x++, index++) {
@@ -322,152 +324,296 @@ void Mapgen::updateLiquid(UniqueQueue<v3s16> *trans_liquid, v3s16 nmin, v3s16 nm
 }
 
 
+*/
+
 void Mapgen::setLighting(u8 light, v3s16 nmin, v3s16 nmax)
 {
-	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen lighting update", SPT_AVG);
-	VoxelArea a(nmin, nmax);
-
-	for (int z = a.MinEdge.z; z <= a.MaxEdge.z; z++) {
-		for (int y = a.MinEdge.y; y <= a.MaxEdge.y; y++) {
-			u32 i = vm->m_area.index(a.MinEdge.x, y, z);
-			for (int x = a.MinEdge.x; x <= a.MaxEdge.x; x++, i++)
-				vm->m_data[i].param1 = light;
-		}
+	ScopeProfiler sp(g_profiler, "Mapgen: setLighting");
+	for (s16 x = nmin.x; x <= nmax.x; x++)
+	for (s16 z = nmin.z; z <= nmax.z; z++) {
+		vm->write_column({x, nmin.y, z}, nmax.y - nmin.y + 1, [light] (MapNode *n, int k, int size) {
+			for (int j = 0; j < size; j++)
+				n[j].light = light;
+		});
 	}
 }
 
 
-void Mapgen::lightSpread(VoxelArea &a, v3s16 p, u8 light)
-{
-	if (light <= 1 || !a.contains(p))
-		return;
-
-	u32 vi = vm->m_area.index(p);
-	MapNode &n = vm->m_data[vi];
-
-	// Decay light in each of the banks separately
-	u8 light_day = light & 0x0F;
-	if (light_day > 0)
-		light_day -= 0x01;
-
-	u8 light_night = light & 0xF0;
-	if (light_night > 0)
-		light_night -= 0x10;
-
-	// Bail out only if we have no more light from either bank to propogate, or
-	// we hit a solid block that light cannot pass through.
-	if ((light_day  <= (n.param1 & 0x0F) &&
-		light_night <= (n.param1 & 0xF0)) ||
-		!ndef->get(n).light_propagates)
-		return;
+/*
+	Lighting works on a copy of the light of the area and of the manip around
+	it, as far as a block out from the faces that have generated blocks
+	beyond them, y fastest like the columns of the manip. The area is lit
+	anew; around it, light only spreads from what is there, so light crosses
+	the faces of the area both ways but does not go further than that block.
+	The copy is surrounded by a border of LIGHT_OPAQUE nodes so that
+	spreading needs no bounds checks. LIGHT_OPAQUE is as bright as any light
+	in both banks, so spreading never enters the nodes light does not
+	propagate through. Instead of recursing into the neighbors of each lit
+	node, spreadLight does a breadth-first flood fill from a flat queue of
+	the nodes whose neighbors may need light.
+*/
 
-	// Since this recursive function only terminates when there is no light from
-	// either bank left, we need to take the max of both banks into account for
-	// the case where spreading has stopped for one light bank but not the other.
-	light = MYMAX(light_day, n.param1 & 0x0F) |
-			MYMAX(light_night, n.param1 & 0xF0);
+void Mapgen::calcLighting(v3s16 nmin, v3s16 nmax, bool underground,
+	const s16 *surface)
+{
+	ScopeProfiler sp(g_profiler, "Mapgen: calcLighting");
 
-	n.param1 = light;
+	loadLight(nmin, nmax);
+	propagateSunlight(nmin, nmax, underground || water_level >= nmax.y, surface);
+	spreadLight();
+	storeLight();
 
-	lightSpread(a, p + v3s16(0, 0, 1), light);
-	lightSpread(a, p + v3s16(0, 1, 0), light);
-	lightSpread(a, p + v3s16(1, 0, 0), light);
-	lightSpread(a, p - v3s16(0, 0, 1), light);
-	lightSpread(a, p - v3s16(0, 1, 0), light);
-	lightSpread(a, p - v3s16(1, 0, 0), light);
+	//printf("updateLighting: %dms\n", t.stop());
 }
 
 
-void Mapgen::calcLighting(v3s16 nmin, v3s16 nmax, v3s16 full_nmin, v3s16 full_nmax,
-	bool propagate_shadow)
+void Mapgen::loadLight(v3s16 nmin, v3s16 nmax)
 {
-	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen lighting update", SPT_AVG);
-	//TimeTaker t("updateLighting");
+	// The area is generated; around it, as far as light from the area
+	// could reach, a block of the manip is unless it has CONTENT_IGNORE
+	// in it
+	v3s16 reach_min = glm::max(nmin - MAP_BLOCKSIZE, vm->MinEdge);
+	v3s16 reach_max = glm::min(nmax + MAP_BLOCKSIZE, vm->MaxEdge);
+	light_min = nmin;
+	light_max = nmax;
+	light_generated.assign(vm->bsize.x * vm->bsize.y * vm->bsize.z, false);
+	v3s16 bmin = vm->split(mt_to_vcore(reach_min)).first;
+	v3s16 bmax = vm->split(mt_to_vcore(reach_max)).first;
+	for (v3s16 vblock: space_range{bmin, bmax + 1}) {
+		v3s16 bnmin = vcore_to_mt(MAP_BLOCKSIZE * vblock);
+		v3s16 bnmax = bnmin + MAP_BLOCKSIZE - 1;
+		bool inside = bnmin.x >= nmin.x && bnmin.y >= nmin.y && bnmin.z >= nmin.z &&
+			bnmax.x <= nmax.x && bnmax.y <= nmax.y && bnmax.z <= nmax.z;
+		const MapBlock &block = vm->getBlock(vblock);
+		bool generated = inside ||
+			std::none_of(std::begin(block.qube), std::end(block.qube),
+				[] (const MapNode &n) { return n.content == CONTENT_IGNORE; });
+		light_generated[vm->index_unsafe(vblock)] = generated;
+		if (!generated || inside)
+			continue;
+		// Only reach out of the faces with generated blocks beyond them
+		for (int k = 0; k < 3; k++) {
+			if (bnmin[k] < nmin[k])
+				light_min[k] = reach_min[k];
+			if (bnmax[k] > nmax[k])
+				light_max[k] = reach_max[k];
+		}
+	}
+	light_size = light_max - light_min + 3;
+	light_buf.assign(light_size.x * light_size.y * light_size.z, LIGHT_OPAQUE);
+	light_queue.clear();
+	sun_bottom.resize((nmax.x - nmin.x + 1) * (nmax.z - nmin.z + 1));
+
+	// Around the area, the light is kept as it is; nodes not generated yet
+	// are opaque
+	bool border = light_min != nmin || light_max != nmax;
+	auto load_border = [&] (s16 x, s16 z, s16 y_min, s16 y_max) {
+		if (y_max < y_min)
+			return;
+		u32 i = lightIndex(v3s16(x, y_min, z));
+		vm->write_column({x, y_min, z}, y_max - y_min + 1, [&] (MapNode *n, int k, int size) {
+			if (!lightGenerated(v3s16(x, y_min + k, z)))
+				return;
+			u8 *light = &light_buf[i + k];
+			for (int j = 0; j < size; j++) {
+				if (light_propagates(n[j].content))
+					light[j] = n[j].light;
+			}
+		});
+	};
+	for (s16 x = light_min.x; x <= light_max.x && border; x++)
+	for (s16 z = light_min.z; z <= light_max.z; z++) {
+		if (x < nmin.x || x > nmax.x || z < nmin.z || z > nmax.z) {
+			load_border(x, z, light_min.y, light_max.y);
+		} else {
+			load_border(x, z, light_min.y, nmin.y - 1);
+			load_border(x, z, nmax.y + 1, light_max.y);
+		}
+	}
 
-	propagateSunlight(nmin, nmax, propagate_shadow);
-	spreadLight(full_nmin, full_nmax);
+	int index = 0;
+	for (s16 x = nmin.x; x <= nmax.x; x++)
+	for (s16 z = nmin.z; z <= nmax.z; z++, index++) {
+		u32 i = lightIndex(v3s16(x, nmin.y, z));
+		// Lowest node the sunlight could reach from the top
+		s16 bottom = nmin.y;
+		vm->write_column({x, nmin.y, z}, nmax.y - nmin.y + 1, [&] (MapNode *n, int k, int size) {
+			// Locals, as stores to u8 could alias anything else
+			u8 *light = &light_buf[i + k];
+			int blocked = -1;
+			for (int j = 0; j < size; j++) {
+				content_t c = n[j].content;
+				if (!sunlight_propagates(c))
+					blocked = j;
+				if (!light_propagates(c))
+					continue;
+				u8 source = light_source(c);
+				light[j] = source | (source << 4);
+				if (source)
+					light_queue.push_back(i + k + j);
+			}
+			if (blocked >= 0)
+				bottom = nmin.y + k + blocked + 1;
+		});
+		sun_bottom[index] = bottom;
+	}
 
-	//printf("updateLighting: %dms\n", t.stop());
+	// The light around comes in through the nodes next to the faces
+	if (!border)
+		return;
+	auto seed = [&] (s16 x, s16 y, s16 z) {
+		u32 i = lightIndex(v3s16(x, y, z));
+		if (light_buf[i] != LIGHT_OPAQUE && light_buf[i] != 0)
+			light_queue.push_back(i);
+	};
+	for (s16 x = nmin.x; x <= nmax.x; x++)
+	for (s16 z = nmin.z; z <= nmax.z; z++) {
+		seed(x, nmin.y - 1, z);
+		seed(x, nmax.y + 1, z);
+	}
+	for (s16 y = nmin.y; y <= nmax.y; y++) {
+		for (s16 z = nmin.z; z <= nmax.z; z++) {
+			seed(nmin.x - 1, y, z);
+			seed(nmax.x + 1, y, z);
+		}
+		for (s16 x = nmin.x; x <= nmax.x; x++) {
+			seed(x, y, nmin.z - 1);
+			seed(x, y, nmax.z + 1);
+		}
+	}
 }
 
 
-void Mapgen::propagateSunlight(v3s16 nmin, v3s16 nmax, bool propagate_shadow)
+void Mapgen::propagateSunlight(v3s16 nmin, v3s16 nmax, bool underground,
+	const s16 *surface)
 {
 	//TimeTaker t("propagateSunlight");
-	VoxelArea a(nmin, nmax);
-	bool block_is_underground = (water_level >= nmax.y);
-	const v3s16 &em = vm->m_area.getExtent();
 
-	// NOTE: Direct access to the low 4 bits of param1 is okay here because,
-	// by definition, sunlight will never be in the night lightbank.
+	// NOTE: Direct access to the low 4 bits of the light is okay here
+	// because, by definition, sunlight will never be in the night lightbank.
 
-	for (int z = a.MinEdge.z; z <= a.MaxEdge.z; z++) {
-		for (int x = a.MinEdge.x; x <= a.MaxEdge.x; x++) {
-			// see if we can get a light value from the overtop
-			u32 i = vm->m_area.index(x, a.MaxEdge.y + 1, z);
-			if (vm->m_data[i].getContent() == CONTENT_IGNORE) {
-				if (block_is_underground)
-					continue;
-			} else if ((vm->m_data[i].param1 & 0x0F) != LIGHT_SUN &&
-					propagate_shadow) {
-				continue;
-			}
-			VoxelArea::add_y(em, i, -1);
-
-			for (int y = a.MaxEdge.y; y >= a.MinEdge.y; y--) {
-				MapNode &n = vm->m_data[i];
-				if (!ndef->get(n).sunlight_propagates)
-					break;
-				n.param1 = LIGHT_SUN;
-				VoxelArea::add_y(em, i, -1);
-			}
+	s16 sx = nmax.x - nmin.x + 1;
+	s16 sz = nmax.z - nmin.z + 1;
+	int index = 0;
+	// Sunlight comes in at the top where the node above has it, if that is
+	// generated already, and else unless the terrain goes on above
+	for (s16 x = 0; x < sx; x++)
+	for (s16 z = 0; z < sz; z++, index++) {
+		MapNode above = vm->get_ign({nmin.x + x, nmax.y + 1, nmin.z + z});
+		bool sun;
+		if (above.content != CONTENT_IGNORE)
+			sun = sunlight_propagates(above.content) && (above.light & 0x0F) == LIGHT_SUN;
+		else
+			sun = !underground && !(surface && surface[x + sx * z] >= nmax.y);
+		if (!sun)
+			sun_bottom[index] = nmax.y + 1;
+	}
+
+	index = 0;
+	for (s16 x = 0; x < sx; x++)
+	for (s16 z = 0; z < sz; z++, index++) {
+		s16 bottom = sun_bottom[index];
+		if (bottom > nmax.y)
+			continue;
+		u32 i = lightIndex(v3s16(nmin.x + x, bottom, nmin.z + z));
+		u8 *light = &light_buf[i];
+		for (s16 k = 0; k <= nmax.y - bottom; k++)
+			light[k] = (light[k] & 0xF0) | LIGHT_SUN;
+
+		// Sunlight only spreads sideways where the neighboring column is not
+		// lit as deep, and down from the bottom of the column. The columns
+		// around the area, where there are any, may not be lit at all, so
+		// those at its edge spread sideways from top to bottom.
+		s16 seed_top = bottom;
+		if (z > 0)
+			seed_top = std::max(seed_top, sun_bottom[index - 1]);
+		if (z < sz - 1)
+			seed_top = std::max(seed_top, sun_bottom[index + 1]);
+		if (x > 0)
+			seed_top = std::max(seed_top, sun_bottom[index - sz]);
+		if (x < sx - 1)
+			seed_top = std::max(seed_top, sun_bottom[index + sz]);
+		if ((x == 0 && light_min.x < nmin.x) || (x == sx - 1 && light_max.x > nmax.x) ||
+				(z == 0 && light_min.z < nmin.z) || (z == sz - 1 && light_max.z > nmax.z))
+			seed_top = nmax.y + 1;
+		seed_top = std::min<s16>(seed_top, nmax.y + 1);
+		light_queue.push_back(i);
+		for (s16 y = bottom + 1; y < seed_top; y++)
+			light_queue.push_back(i + y - bottom);
+
+		// Down out of the area, until something stops it
+		if (bottom != nmin.y)
+			continue;
+		for (s16 y = nmin.y - 1; y >= light_min.y; y--) {
+			v3s16 p(nmin.x + x, y, nmin.z + z);
+			u32 j = lightIndex(p);
+			if (light_buf[j] == LIGHT_OPAQUE || !sunlight_propagates(vm->get_r(p).content))
+				break;
+			light_buf[j] = (light_buf[j] & 0xF0) | LIGHT_SUN;
+			light_queue.push_back(j);
 		}
 	}
 	//printf("propagateSunlight: %dms\n", t.stop());
 }
 
 
-void Mapgen::spreadLight(v3s16 nmin, v3s16 nmax)
+void Mapgen::spreadLight()
 {
 	//TimeTaker t("spreadLight");
-	VoxelArea a(nmin, nmax);
-
-	for (int z = a.MinEdge.z; z <= a.MaxEdge.z; z++) {
-		for (int y = a.MinEdge.y; y <= a.MaxEdge.y; y++) {
-			u32 i = vm->m_area.index(a.MinEdge.x, y, z);
-			for (int x = a.MinEdge.x; x <= a.MaxEdge.x; x++, i++) {
-				MapNode &n = vm->m_data[i];
-				if (n.getContent() == CONTENT_IGNORE)
-					continue;
-
-				const ContentFeatures &cf = ndef->get(n);
-				if (!cf.light_propagates)
-					continue;
+	const s32 steps[6] = {
+		1, -1,
+		light_size.y, -light_size.y,
+		light_size.y * light_size.z, -light_size.y * light_size.z,
+	};
+
+	// The queue grows while it is walked
+	for (size_t head = 0; head < light_queue.size(); head++) {
+		u32 i = light_queue[head];
+		u8 light = light_buf[i];
+
+		// Decay light in each of the banks separately
+		u8 light_day = light & 0x0F;
+		if (light_day > 0)
+			light_day -= 0x01;
+
+		u8 light_night = light & 0xF0;
+		if (light_night > 0)
+			light_night -= 0x10;
+
+		if (light_day == 0 && light_night == 0)
+			continue;
 
-				// TODO(hmmmmm): Abstract away direct param1 accesses with a
-				// wrapper, but something lighter than MapNode::get/setLight
-
-				u8 light_produced = cf.light_source;
-				if (light_produced)
-					n.param1 = light_produced | (light_produced << 4);
-
-				u8 light = n.param1;
-				if (light) {
-					lightSpread(a, v3s16(x,     y,     z + 1), light);
-					lightSpread(a, v3s16(x,     y + 1, z    ), light);
-					lightSpread(a, v3s16(x + 1, y,     z    ), light);
-					lightSpread(a, v3s16(x,     y,     z - 1), light);
-					lightSpread(a, v3s16(x,     y - 1, z    ), light);
-					lightSpread(a, v3s16(x - 1, y,     z    ), light);
-				}
-			}
+		for (s32 step : steps) {
+			u32 n = i + step;
+			u8 old = light_buf[n];
+			// Spreading stops for one bank and not the other where the
+			// neighbor already has the light of just one of them
+			u8 lit = std::max<u8>(light_day, old & 0x0F) |
+				std::max<u8>(light_night, old & 0xF0);
+			if (lit == old)
+				continue;
+			light_buf[n] = lit;
+			light_queue.push_back(n);
 		}
 	}
-
 	//printf("spreadLight: %dms\n", t.stop());
 }
 
-*/
+
+void Mapgen::storeLight()
+{
+	// The blocks not generated yet only have opaque nodes, with no light
+	for (s16 x = light_min.x; x <= light_max.x; x++)
+	for (s16 z = light_min.z; z <= light_max.z; z++) {
+		u32 i = lightIndex(v3s16(x, light_min.y, z));
+		vm->write_column({x, light_min.y, z}, light_max.y - light_min.y + 1, [&] (MapNode *n, int k, int size) {
+			const u8 *light = &light_buf[i + k];
+			for (int j = 0; j < size; j++)
+				n[j].light = light[j] == LIGHT_OPAQUE ? 0 : light[j];
+		});
+	}
+}
+
 ////
 //// MapgenBasic
 ////
@@ -33,10 +33,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // #include "util/container.h"
 
 static constexpr int MAX_MAP_GENERATION_LIMIT = 31000;
-static constexpr int CHUNK_SIZE_BLOCKS = 5;
-static constexpr int CHUNK_SIZE = CHUNK_SIZE_BLOCKS * MAP_BLOCKSIZE;
 static constexpr int CHUNK_PADDING = 0;
-static constexpr int CHUNK_PADDING_BLOCKS = (CHUNK_PADDING + MAP_BLOCKSIZE - 1) / MAP_BLOCKSIZE;
+// Blocks of the neighbouring chunks in the manip, for the trees and the
+// light to reach into. Only CHUNK_PADDING nodes of them are generated with
+// the chunk.
+static constexpr int CHUNK_PADDING_BLOCKS = 1;
 
 /////////////////// Mapgen flags
 #define MG_TREES       0x01  // Deprecated. Moved into mgv6 flags
@@ -123,7 +124,7 @@ struct MapgenParams {
 	MapgenParams() = default;
 	virtual ~MapgenParams();
 
-	s16 chunksize = 5;
+	s16 chunksize = 5; // edge of a chunk, in blocks; a mapgen only makes chunks of this size
 	u64 seed = 0;
 	s16 water_level = 1;
 	s16 mapgen_limit = MAX_MAP_GENERATION_LIMIT;
@@ -197,11 +198,17 @@ public:
 		std::vector<s16> &floors, std::vector<s16> &ceilings);
 
 	void setLighting(u8 light, v3s16 nmin, v3s16 nmax);
-	void lightSpread(VoxelArea &a, v3s16 p, u8 light);
-	void calcLighting(v3s16 nmin, v3s16 nmax, v3s16 full_nmin, v3s16 full_nmax,
-		bool propagate_shadow = true);
-	void propagateSunlight(v3s16 nmin, v3s16 nmax, bool propagate_shadow);
-	void spreadLight(v3s16 nmin, v3s16 nmax);
+	// Lights the area from the sun and the light sources in it, and from
+	// the light of the manip around it, which it spreads to in turn up to
+	// a block away. Light around the area only ever gets brighter. The top
+	// of the area gets sunlight where the node above has it, if that is
+	// set; elsewhere unless it is below water_level or underground.
+	// If there is `surface`, the terrain height of each column of the area,
+	// x fastest, the columns where it is at or above the top of the area
+	// get no sunlight from there either: the ground goes on above them,
+	// even where a cave reaches the top.
+	void calcLighting(v3s16 nmin, v3s16 nmax, bool underground = false,
+		const s16 *surface = nullptr);
 
 	virtual void makeChunk(BlockMakeData *data) {}
 	virtual int getGroundLevelAtPoint(v2s16 p) { return 0; }
@@ -226,6 +233,37 @@ private:
 	// that checks whether there are floodable nodes without liquid beneath
 	// the node at index vi.
 	inline bool isLiquidHorizontallyFlowable(u32 vi, v3s16 em);
+
+	// Light of the area calcLighting works on and of the manip around it,
+	// with a border of LIGHT_OPAQUE
+	static constexpr u8 LIGHT_OPAQUE = 0xFF;
+	v3s16 light_min;
+	v3s16 light_max;
+	v3s16 light_size;
+	std::vector<u8> light_buf;
+	// Nodes to spread light from
+	std::vector<u32> light_queue;
+	// Per column of the area, from the loaded nodes
+	std::vector<s16> sun_bottom;
+	// Per block of the manip, whether it is generated, and so has light to
+	// load. The blocks not generated yet have CONTENT_IGNORE in them, and
+	// are left opaque.
+	std::vector<bool> light_generated;
+
+	u32 lightIndex(v3s16 p) const
+	{
+		p = p - light_min + 1;
+		return p.y + light_size.y * (p.z + light_size.z * p.x);
+	}
+	bool lightGenerated(v3s16 p) const
+	{
+		return light_generated[vm->index_unsafe(vm->split(mt_to_vcore(p)).first)];
+	}
+	void loadLight(v3s16 nmin, v3s16 nmax);
+	void propagateSunlight(v3s16 nmin, v3s16 nmax, bool underground,
+		const s16 *surface);
+	void spreadLight();
+	void storeLight();
 };
 
 /*
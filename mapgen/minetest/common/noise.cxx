@@ -24,6 +24,9 @@
  */
 
 #include "noise.hxx"
+#include "noise_scratch.hxx"
+#include "noise_simd.hxx"
+#include <algorithm>
 #include <cmath>
 #include <cstring> // memset
 
@@ -32,15 +35,6 @@
 #define NOISE_MAGIC_Z    52591
 #define NOISE_MAGIC_SEED 1013
 
-typedef float (*Interp2dFxn)(
-		float v00, float v10, float v01, float v11,
-		float x, float y);
-
-typedef float (*Interp3dFxn)(
-		float v000, float v100, float v010, float v110,
-		float v001, float v101, float v011, float v111,
-		float x, float y, float z);
-
 float cos_lookup[16] = {
 	1.0f,  0.9238f,  0.7071f,  0.3826f, .0f, -0.3826f, -0.7071f, -0.9238f,
 	1.0f, -0.9238f, -0.7071f, -0.3826f, .0f,  0.3826f,  0.7071f,  0.9238f
@@ -77,6 +71,24 @@ float noise3d(int x, int y, int z, s32 seed)
 }
 
 
+// Along a row, the hash input only grows by NOISE_MAGIC_X per point.
+// Computed unsigned, which wraps around the same as the int expressions above.
+void noise2d_row(float *out, u32 count, int x, int y, s32 seed)
+{
+	u32 n0 = (u32)NOISE_MAGIC_X * x + (u32)NOISE_MAGIC_Y * y
+			+ (u32)NOISE_MAGIC_SEED * seed;
+	latticeRow(out, count, n0, NOISE_MAGIC_X);
+}
+
+
+void noise3d_row(float *out, u32 count, int x, int y, int z, s32 seed)
+{
+	u32 n0 = (u32)NOISE_MAGIC_X * x + (u32)NOISE_MAGIC_Y * y
+			+ (u32)NOISE_MAGIC_Z * z + (u32)NOISE_MAGIC_SEED * seed;
+	latticeRow(out, count, n0, NOISE_MAGIC_X);
+}
+
+
 inline float dotProduct(float vx, float vy, float wx, float wy)
 {
 	return vx * wx + vy * wy;
@@ -191,6 +203,22 @@ float noise3d_gradient(float x, float y, float z, s32 seed, bool eased)
 }
 
 
+float noise2d_simplex(float x, float y, s32 seed)
+{
+	float value;
+	simplexRow2D(&value, 1, x, 0.f, y, seed);
+	return value;
+}
+
+
+float noise3d_simplex(float x, float y, float z, s32 seed)
+{
+	float value;
+	simplexRow3D(&value, 1, x, 0.f, y, z, seed);
+	return value;
+}
+
+
 float noise2d_perlin(float x, float y, s32 seed,
 	int octaves, float persistence, bool eased)
 {
@@ -252,15 +280,6 @@ float noise3d_perlin_abs(float x, float y, float z, s32 seed,
 }
 
 
-float contour(float v)
-{
-	v = std::fabs(v);
-	if (v >= 1.0)
-		return 0.0;
-	return (1.0 - v);
-}
-
-
 ///////////////////////// [ New noise ] ////////////////////////////
 
 
@@ -275,8 +294,10 @@ float NoisePerlin2D(NoiseParams *np, float x, float y, s32 seed)
 	seed += np->seed;
 
 	for (size_t i = 0; i < np->octaves; i++) {
-		float noiseval = noise2d_gradient(x * f, y * f, seed + i,
-			np->flags & (NOISE_FLAG_DEFAULTS | NOISE_FLAG_EASED));
+		float noiseval = (np->flags & NOISE_FLAG_SIMPLEX) ?
+			noise2d_simplex(x * f, y * f, seed + i) :
+			noise2d_gradient(x * f, y * f, seed + i,
+				np->flags & (NOISE_FLAG_DEFAULTS | NOISE_FLAG_EASED));
 
 		if (np->flags & NOISE_FLAG_ABSVALUE)
 			noiseval = std::fabs(noiseval);
@@ -302,8 +323,10 @@ float NoisePerlin3D(NoiseParams *np, float x, float y, float z, s32 seed)
 	seed += np->seed;
 
 	for (size_t i = 0; i < np->octaves; i++) {
-		float noiseval = noise3d_gradient(x * f, y * f, z * f, seed + i,
-			np->flags & NOISE_FLAG_EASED);
+		float noiseval = (np->flags & NOISE_FLAG_SIMPLEX) ?
+			noise3d_simplex(x * f, y * f, z * f, seed + i) :
+			noise3d_gradient(x * f, y * f, z * f, seed + i,
+				np->flags & NOISE_FLAG_EASED);
 
 		if (np->flags & NOISE_FLAG_ABSVALUE)
 			noiseval = std::fabs(noiseval);
@@ -331,10 +354,8 @@ Noise::Noise(NoiseParams *np_, s32 seed, u32 sx, u32 sy, u32 sz)
 
 Noise::~Noise()
 {
-	delete[] gradient_buf;
-	delete[] persist_buf;
-	delete[] noise_buf;
 	delete[] result;
+	delete coarse;
 }
 
 
@@ -347,18 +368,25 @@ void Noise::allocBuffers()
 	if (sz < 1)
 		sz = 1;
 
-	this->noise_buf = NULL;
-	resizeNoiseBuf(sz > 1);
+	checkLatticeSize();
+
+	// Sizes that fit the buffers keep them, for maps resized every chunk
+	if (coarse) {
+		u32 step = pointBufferSpacing();
+		coarse->setSize((sx - 1) / step + 2, (sy - 1) / step + 2, (sz - 1) / step + 2);
+	}
+
+	size_t bufsize = sx * sy * sz;
+	if (bufsize <= result_capacity)
+		return;
 
-	delete[] gradient_buf;
-	delete[] persist_buf;
 	delete[] result;
+	result = nullptr;
+	result_capacity = 0;
 
 	try {
-		size_t bufsize = sx * sy * sz;
-		this->persist_buf  = NULL;
-		this->gradient_buf = new float[bufsize];
-		this->result       = new float[bufsize];
+		this->result = new float[bufsize];
+		result_capacity = bufsize;
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -379,7 +407,9 @@ void Noise::setSpreadFactor(v3f spread)
 {
 	this->np.spread = spread;
 
-	resizeNoiseBuf(sz > 1);
+	checkLatticeSize();
+	delete coarse;
+	coarse = nullptr;
 }
 
 
@@ -387,11 +417,17 @@ void Noise::setOctaves(int octaves)
 {
 	this->np.octaves = octaves;
 
-	resizeNoiseBuf(sz > 1);
+	checkLatticeSize();
+	delete coarse;
+	coarse = nullptr;
 }
 
 
-void Noise::resizeNoiseBuf(bool is3d)
+/*
+ * The lattice itself is sized by each gradientMap2D/3D call, this only
+ * rejects parameters that would need an absurdly large one.
+ */
+void Noise::checkLatticeSize()
 {
 	//maximum possible spread value factor
 	float ofactor = (np.lacunarity > 1.0) ?
@@ -409,19 +445,6 @@ void Noise::resizeNoiseBuf(bool is3d)
 		num_noise_points_y > 1000000000.f ||
 		num_noise_points_z > 1000000000.f)
 		throw InvalidNoiseParamsException();
-
-	// + 2 for the two initial endpoints
-	// + 1 for potentially crossing a boundary due to offset
-	size_t nlx = (size_t)std::ceil(num_noise_points_x) + 3;
-	size_t nly = (size_t)std::ceil(num_noise_points_y) + 3;
-	size_t nlz = is3d ? (size_t)std::ceil(num_noise_points_z) + 3 : 1;
-
-	delete[] noise_buf;
-	try {
-		noise_buf = new float[nlx * nly * nlz];
-	} catch (std::bad_alloc &e) {
-		throw InvalidNoiseParamsException();
-	}
 }
 
 
@@ -436,59 +459,67 @@ void Noise::resizeNoiseBuf(bool is3d)
  * values from the previous noise lattice as midpoints in the new lattice for the
  * next octave.
  */
+/*
+ * The lattice advance along x doesn't depend on the row, so it is done once,
+ * into per-column tables, and every row is then interpolated by a SIMD kernel
+ * (see noise_simd.hxx). The results are the same as of one-by-one evaluation.
+ */
+void Noise::precomputeColumns(u32 *column_noisex, float *column_tx,
+		float u, float step_x, bool eased)
+{
+	u32 noisex = 0;
+	for (u32 i = 0; i != sx; i++) {
+		column_noisex[i] = noisex;
+		column_tx[i] = eased ? easeCurve(u) : u;
+
+		u += step_x;
+		if (u >= 1.0) {
+			u -= 1.0;
+			noisex++;
+		}
+	}
+}
+
+
 #define idx(x, y) ((y) * nlx + (x))
-void Noise::gradientMap2D(
+void Noise::gradientMap2D(float *out,
 		float x, float y,
 		float step_x, float step_y,
 		s32 seed)
 {
-	float v00, v01, v10, v11, u, v, orig_u;
-	u32 index, i, j, noisex, noisey;
+	float u, v;
+	u32 index, j, noisey;
 	u32 nlx, nly;
 	s32 x0, y0;
 
 	bool eased = np.flags & (NOISE_FLAG_DEFAULTS | NOISE_FLAG_EASED);
-	Interp2dFxn interpolate = eased ?
-		biLinearInterpolation : biLinearInterpolationNoEase;
 
 	x0 = std::floor(x);
 	y0 = std::floor(y);
 	u = x - (float)x0;
 	v = y - (float)y0;
-	orig_u = u;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
-	index = 0;
+	NoiseScratch::Frame frame;
+	float *noise_buf = frame.alloc<float>(nlx * nly);
 	for (j = 0; j != nly; j++)
-		for (i = 0; i != nlx; i++)
-			noise_buf[index++] = noise2d(x0 + i, y0 + j, seed);
+		noise2d_row(&noise_buf[idx(0, j)], nlx, x0, y0 + j, seed);
 
 	//calculate interpolations
+	u32 *column_noisex = frame.alloc<u32>(sx);
+	float *column_tx = frame.alloc<float>(sx);
+	precomputeColumns(column_noisex, column_tx, u, step_x, eased);
 	index  = 0;
 	noisey = 0;
 	for (j = 0; j != sy; j++) {
-		v00 = noise_buf[idx(0, noisey)];
-		v10 = noise_buf[idx(1, noisey)];
-		v01 = noise_buf[idx(0, noisey + 1)];
-		v11 = noise_buf[idx(1, noisey + 1)];
-
-		u = orig_u;
-		noisex = 0;
-		for (i = 0; i != sx; i++) {
-			gradient_buf[index++] = interpolate(v00, v10, v01, v11, u, v);
-
-			u += step_x;
-			if (u >= 1.0) {
-				u -= 1.0;
-				noisex++;
-				v00 = v10;
-				v01 = v11;
-				v10 = noise_buf[idx(noisex + 1, noisey)];
-				v11 = noise_buf[idx(noisex + 1, noisey + 1)];
-			}
-		}
+		gradientRow2D(&out[index], sx,
+			&noise_buf[idx(0, noisey)],
+			&noise_buf[idx(0, noisey + 1)],
+			column_noisex, column_tx,
+			eased ? easeCurve(v) : v);
+		index += sx;
 
 		v += step_y;
 		if (v >= 1.0) {
@@ -501,20 +532,17 @@ void Noise::gradientMap2D(
 
 
 #define idx(x, y, z) ((z) * nly * nlx + (y) * nlx + (x))
-void Noise::gradientMap3D(
+void Noise::gradientMap3D(float *out,
 		float x, float y, float z,
 		float step_x, float step_y, float step_z,
 		s32 seed)
 {
-	float v000, v010, v100, v110;
-	float v001, v011, v101, v111;
-	float u, v, w, orig_u, orig_v;
-	u32 index, i, j, k, noisex, noisey, noisez;
+	float u, v, w, orig_v, tz;
+	u32 index, j, k, noisey, noisez;
 	u32 nlx, nly, nlz;
 	s32 x0, y0, z0;
 
-	Interp3dFxn interpolate = (np.flags & NOISE_FLAG_EASED) ?
-		triLinearInterpolation : triLinearInterpolationNoEase;
+	bool eased = np.flags & NOISE_FLAG_EASED;
 
 	x0 = std::floor(x);
 	y0 = std::floor(y);
@@ -522,58 +550,37 @@ void Noise::gradientMap3D(
 	u = x - (float)x0;
 	v = y - (float)y0;
 	w = z - (float)z0;
-	orig_u = u;
 	orig_v = v;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
 	nlz = (u32)(w + sz * step_z) + 2;
-	index = 0;
+	NoiseScratch::Frame frame;
+	float *noise_buf = frame.alloc<float>(nlx * nly * nlz);
 	for (k = 0; k != nlz; k++)
 		for (j = 0; j != nly; j++)
-			for (i = 0; i != nlx; i++)
-				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+			noise3d_row(&noise_buf[idx(0, j, k)], nlx, x0, y0 + j, z0 + k, seed);
 
 	//calculate interpolations
+	u32 *column_noisex = frame.alloc<u32>(sx);
+	float *column_tx = frame.alloc<float>(sx);
+	precomputeColumns(column_noisex, column_tx, u, step_x, eased);
 	index  = 0;
-	noisey = 0;
 	noisez = 0;
 	for (k = 0; k != sz; k++) {
+		tz = eased ? easeCurve(w) : w;
 		v = orig_v;
 		noisey = 0;
 		for (j = 0; j != sy; j++) {
-			v000 = noise_buf[idx(0, noisey,     noisez)];
-			v100 = noise_buf[idx(1, noisey,     noisez)];
-			v010 = noise_buf[idx(0, noisey + 1, noisez)];
-			v110 = noise_buf[idx(1, noisey + 1, noisez)];
-			v001 = noise_buf[idx(0, noisey,     noisez + 1)];
-			v101 = noise_buf[idx(1, noisey,     noisez + 1)];
-			v011 = noise_buf[idx(0, noisey + 1, noisez + 1)];
-			v111 = noise_buf[idx(1, noisey + 1, noisez + 1)];
-
-			u = orig_u;
-			noisex = 0;
-			for (i = 0; i != sx; i++) {
-				gradient_buf[index++] = interpolate(
-					v000, v100, v010, v110,
-					v001, v101, v011, v111,
-					u, v, w);
-
-				u += step_x;
-				if (u >= 1.0) {
-					u -= 1.0;
-					noisex++;
-					v000 = v100;
-					v010 = v110;
-					v100 = noise_buf[idx(noisex + 1, noisey,     noisez)];
-					v110 = noise_buf[idx(noisex + 1, noisey + 1, noisez)];
-					v001 = v101;
-					v011 = v111;
-					v101 = noise_buf[idx(noisex + 1, noisey,     noisez + 1)];
-					v111 = noise_buf[idx(noisex + 1, noisey + 1, noisez + 1)];
-				}
-			}
+			gradientRow3D(&out[index], sx,
+				&noise_buf[idx(0, noisey,     noisez)],
+				&noise_buf[idx(0, noisey + 1, noisez)],
+				&noise_buf[idx(0, noisey,     noisez + 1)],
+				&noise_buf[idx(0, noisey + 1, noisez + 1)],
+				column_noisex, column_tx,
+				eased ? easeCurve(v) : v, tz);
+			index += sx;
 
 			v += step_y;
 			if (v >= 1.0) {
@@ -592,6 +599,38 @@ void Noise::gradientMap3D(
 #undef idx
 
 
+/*
+ * Simplex noise needs no lattice: each point is evaluated on its own, from
+ * the 3 or 4 corners of its simplex, by the row kernels of noise_simd.hxx.
+ * Point i of a row is at x + i * step_x, not a running sum like above.
+ */
+void Noise::simplexMap2D(float *out,
+		float x, float y,
+		float step_x, float step_y,
+		s32 seed)
+{
+	for (u32 j = 0; j != sy; j++)
+		simplexRow2D(&out[j * sx], sx,
+			x, step_x, y + (float)j * step_y, seed);
+}
+
+
+void Noise::simplexMap3D(float *out,
+		float x, float y, float z,
+		float step_x, float step_y, float step_z,
+		s32 seed)
+{
+	u32 index = 0;
+	for (u32 k = 0; k != sz; k++) {
+		for (u32 j = 0; j != sy; j++) {
+			simplexRow3D(&out[index], sx,
+				x, step_x, y + (float)j * step_y, z + (float)k * step_z, seed);
+			index += sx;
+		}
+	}
+}
+
+
 float *Noise::perlinMap2D(float x, float y, float *persistence_map)
 {
 	float f = 1.0, g = 1.0;
@@ -602,19 +641,26 @@ float *Noise::perlinMap2D(float x, float y, float *persistence_map)
 
 	memset(result, 0, sizeof(float) * bufsize);
 
+	NoiseScratch::Frame frame;
+	float *gradient_buf = frame.alloc<float>(bufsize);
+	float *persist_buf = nullptr;
 	if (persistence_map) {
-		if (!persist_buf)
-			persist_buf = new float[bufsize];
+		persist_buf = frame.alloc<float>(bufsize);
 		for (size_t i = 0; i != bufsize; i++)
 			persist_buf[i] = 1.0;
 	}
 
 	for (size_t oct = 0; oct < np.octaves; oct++) {
-		gradientMap2D(x * f, y * f,
-			f / np.spread.x, f / np.spread.y,
-			seed + np.seed + oct);
+		if (np.flags & NOISE_FLAG_SIMPLEX)
+			simplexMap2D(gradient_buf, x * f, y * f,
+				f / np.spread.x, f / np.spread.y,
+				seed + np.seed + oct);
+		else
+			gradientMap2D(gradient_buf, x * f, y * f,
+				f / np.spread.x, f / np.spread.y,
+				seed + np.seed + oct);
 
-		updateResults(g, persist_buf, persistence_map, bufsize);
+		updateResults(g, gradient_buf, persist_buf, persistence_map, bufsize);
 
 		f *= np.lacunarity;
 		g *= np.persist;
@@ -631,6 +677,10 @@ float *Noise::perlinMap2D(float x, float y, float *persistence_map)
 
 float *Noise::perlinMap3D(float x, float y, float z, float *persistence_map)
 {
+	if ((np.flags & NOISE_FLAG_POINTBUFFER) && !persistence_map &&
+			pointBufferSpacing() > 1)
+		return pointBufferMap3D(x, y, z);
+
 	float f = 1.0, g = 1.0;
 	size_t bufsize = sx * sy * sz;
 
@@ -640,19 +690,26 @@ float *Noise::perlinMap3D(float x, float y, float z, float *persistence_map)
 
 	memset(result, 0, sizeof(float) * bufsize);
 
+	NoiseScratch::Frame frame;
+	float *gradient_buf = frame.alloc<float>(bufsize);
+	float *persist_buf = nullptr;
 	if (persistence_map) {
-		if (!persist_buf)
-			persist_buf = new float[bufsize];
+		persist_buf = frame.alloc<float>(bufsize);
 		for (size_t i = 0; i != bufsize; i++)
 			persist_buf[i] = 1.0;
 	}
 
 	for (size_t oct = 0; oct < np.octaves; oct++) {
-		gradientMap3D(x * f, y * f, z * f,
-			f / np.spread.x, f / np.spread.y, f / np.spread.z,
-			seed + np.seed + oct);
+		if (np.flags & NOISE_FLAG_SIMPLEX)
+			simplexMap3D(gradient_buf, x * f, y * f, z * f,
+				f / np.spread.x, f / np.spread.y, f / np.spread.z,
+				seed + np.seed + oct);
+		else
+			gradientMap3D(gradient_buf, x * f, y * f, z * f,
+				f / np.spread.x, f / np.spread.y, f / np.spread.z,
+				seed + np.seed + oct);
 
-		updateResults(g, persist_buf, persistence_map, bufsize);
+		updateResults(g, gradient_buf, persist_buf, persistence_map, bufsize);
 
 		f *= np.lacunarity;
 		g *= np.persist;
@@ -667,7 +724,204 @@ float *Noise::perlinMap3D(float x, float y, float z, float *persistence_map)
 }
 
 
-void Noise::updateResults(float g, float *gmap,
+/*
+ * NOISE_FLAG_POINTBUFFER: the noise is evaluated on a grid pointBufferSpacing()
+ * times coarser, one point past the map on each side, and trilinearly
+ * interpolated. The coarse grid is an ordinary Noise with its spread scaled
+ * down, so that its points fall exactly on every point_spacing-th node.
+ * Interpolating between grid points is what gradientRow3D does, so it does
+ * the upsampling too.
+ */
+u32 Noise::pointBufferSpacing() const
+{
+	// same as in resizeNoiseBuf
+	float ofactor = (np.lacunarity > 1.0) ?
+		pow(np.lacunarity, np.octaves - 1) :
+		np.lacunarity;
+	float spread = std::min(std::min(np.spread.x, np.spread.y), np.spread.z);
+	float finest = std::floor(spread / ofactor);
+	if (finest < np.point_spacing)
+		return finest < 1.0f ? 1 : (u32)finest;
+	return np.point_spacing;
+}
+
+
+float *Noise::pointBufferMap3D(float x, float y, float z)
+{
+	u32 step = pointBufferSpacing();
+
+	if (!coarse) {
+		NoiseParams coarse_np = np;
+		coarse_np.flags &= ~NOISE_FLAG_POINTBUFFER;
+		coarse_np.spread /= (float)step;
+		coarse = new Noise(&coarse_np, seed,
+			(sx - 1) / step + 2, (sy - 1) / step + 2, (sz - 1) / step + 2);
+	}
+	const float *grid = coarse->perlinMap3D(x / step, y / step, z / step);
+	u32 gx = coarse->sx;
+	u32 gy = coarse->sy;
+
+	NoiseScratch::Frame frame;
+	u32 *column_noisex = frame.alloc<u32>(sx);
+	float *column_tx = frame.alloc<float>(sx);
+	for (u32 i = 0; i != sx; i++) {
+		column_noisex[i] = i / step;
+		column_tx[i] = (float)(i % step) / step;
+	}
+
+	u32 index = 0;
+	for (u32 k = 0; k != sz; k++) {
+		u32 gz = k / step;
+		float tz = (float)(k % step) / step;
+		for (u32 j = 0; j != sy; j++) {
+			u32 gj = j / step;
+			float ty = (float)(j % step) / step;
+			gradientRow3D(&result[index], sx,
+				&grid[(gz * gy + gj) * gx],
+				&grid[(gz * gy + gj + 1) * gx],
+				&grid[((gz + 1) * gy + gj) * gx],
+				&grid[((gz + 1) * gy + gj + 1) * gx],
+				column_noisex, column_tx, ty, tz);
+			index += sx;
+		}
+	}
+	return result;
+}
+
+
+FusedNoise2D::FusedNoise2D(std::vector<Noise *> noises_) :
+	noises(std::move(noises_))
+{
+	sx = noises.at(0)->sx;
+	sy = noises.at(0)->sy;
+	for (Noise *noise : noises) {
+		if (noise->sx != sx || noise->sy != sy || noise->sz != 1)
+			throw InvalidNoiseParamsException();
+		for (size_t oct = 0; oct < noise->np.octaves; oct++)
+			octaves.push_back({noise});
+	}
+}
+
+
+// Does what Noise::gradientMap2D does before interpolating
+void FusedNoise2D::setupOctave(NoiseScratch::Frame &frame, Octave &o,
+	float x, float y, float f, s32 seed)
+{
+	const NoiseParams &np = o.noise->np;
+	float step_x = f / np.spread.x;
+	o.step_y = f / np.spread.y;
+	o.eased = np.flags & (NOISE_FLAG_DEFAULTS | NOISE_FLAG_EASED);
+	o.simplex = np.flags & NOISE_FLAG_SIMPLEX;
+	o.seed = seed;
+
+	x *= f;
+	y *= f;
+	if (o.simplex) {
+		// see Noise::simplexMap2D, no lattice needed
+		o.x = x;
+		o.step_x = step_x;
+		o.y = y;
+		o.v = 0.0f;
+		o.noisey = 0;
+		return;
+	}
+	s32 x0 = std::floor(x);
+	s32 y0 = std::floor(y);
+	float u = x - (float)x0;
+	o.v = y - (float)y0;
+	o.noisey = 0;
+
+	o.nlx = (u32)(u + sx * step_x) + 2;
+	u32 nly = (u32)(o.v + sy * o.step_y) + 2;
+	o.lattice = frame.alloc<float>(o.nlx * nly);
+	for (u32 j = 0; j != nly; j++)
+		noise2d_row(&o.lattice[j * o.nlx], o.nlx, x0, y0 + j, seed);
+
+	o.noisex = frame.alloc<u32>(sx);
+	o.tx = frame.alloc<float>(sx);
+	u32 noisex = 0;
+	for (u32 i = 0; i != sx; i++) {
+		o.noisex[i] = noisex;
+		o.tx[i] = o.eased ? easeCurve(u) : u;
+
+		u += step_x;
+		if (u >= 1.0) {
+			u -= 1.0;
+			noisex++;
+		}
+	}
+}
+
+
+void FusedNoise2D::perlinMap2D_PO(float x, float xoff, float y, float yoff,
+	const RowCallback &row_done)
+{
+	// Same steps as Noise::perlinMap2D_PO and perlinMap2D
+	NoiseScratch::Frame frame;
+	float *row = frame.alloc<float>(sx);
+	auto octave = octaves.begin();
+	for (Noise *noise : noises) {
+		const NoiseParams &np = noise->np;
+		float nx = x + xoff * np.spread.x;
+		float ny = y + yoff * np.spread.y;
+		nx /= np.spread.x;
+		ny /= np.spread.y;
+		float f = 1.0, g = 1.0;
+		for (size_t oct = 0; oct < np.octaves; oct++, octave++) {
+			octave->g = g;
+			setupOctave(frame, *octave, nx, ny, f, noise->seed + np.seed + oct);
+			f *= np.lacunarity;
+			g *= np.persist;
+		}
+	}
+
+	for (u32 j = 0; j != sy; j++) {
+		u32 begin = j * sx;
+		octave = octaves.begin();
+		for (Noise *noise : noises) {
+			const NoiseParams &np = noise->np;
+			float *result = &noise->result[begin];
+			memset(result, 0, sizeof(float) * sx);
+
+			for (size_t oct = 0; oct < np.octaves; oct++, octave++) {
+				Octave &o = *octave;
+				if (o.simplex)
+					simplexRow2D(row, sx,
+						o.x, o.step_x, o.y + (float)j * o.step_y, o.seed);
+				else
+					gradientRow2D(row, sx,
+						&o.lattice[o.noisey * o.nlx],
+						&o.lattice[(o.noisey + 1) * o.nlx],
+						o.noisex, o.tx,
+						o.eased ? easeCurve(o.v) : o.v);
+
+				if (np.flags & NOISE_FLAG_ABSVALUE) {
+					for (u32 i = 0; i != sx; i++)
+						result[i] += o.g * std::fabs(row[i]);
+				} else {
+					for (u32 i = 0; i != sx; i++)
+						result[i] += o.g * row[i];
+				}
+
+				o.v += o.step_y;
+				if (o.v >= 1.0) {
+					o.v -= 1.0;
+					o.noisey++;
+				}
+			}
+
+			if (std::fabs(np.offset - 0.f) > 0.00001 || std::fabs(np.scale - 1.f) > 0.00001) {
+				for (u32 i = 0; i != sx; i++)
+					result[i] = result[i] * np.scale + np.offset;
+			}
+		}
+		if (row_done)
+			row_done(begin, begin + sx);
+	}
+}
+
+
+void Noise::updateResults(float g, const float *gradient_buf, float *gmap,
 	const float *persistence_map, size_t bufsize)
 {
 	// This looks very ugly, but it is 50-70% faster than having
@@ -24,19 +24,60 @@
  */
 
 #pragma once
+#include <cmath>
+#include <functional>
 #include <stdexcept>
+#include <vector>
+#include "noise_scratch.hxx"
 #include "types.hxx"
 
 #define NOISE_FLAG_DEFAULTS    0x01
 #define NOISE_FLAG_EASED       0x02
 #define NOISE_FLAG_ABSVALUE    0x04
-
-//// TODO(hmmmm): implement these!
 #define NOISE_FLAG_POINTBUFFER 0x08
+// Simplex noise instead of the value lattice; EASED doesn't apply to it.
+// Opt-in only, never part of the defaults: it is slower than the lattice,
+// which hashes one point per cell and then only interpolates
 #define NOISE_FLAG_SIMPLEX     0x10
 
 struct InvalidNoiseParamsException: public std::exception {};
 
+// The linear congruential generator of Minetest; seeded per chunk, it gives
+// the same sequence whichever thread generates the chunk
+class PseudoRandom {
+public:
+	static const u32 RANDOM_RANGE = 32767;
+
+	PseudoRandom(s32 seed_=0)
+	{
+		seed(seed_);
+	}
+
+	void seed(s32 seed)
+	{
+		m_next = seed;
+	}
+
+	u32 next()
+	{
+		m_next = static_cast<u32>(m_next) * 1103515245U + 12345U;
+		return static_cast<u32>(m_next / 65536) % (RANDOM_RANGE + 1U);
+	}
+
+	s32 range(s32 min, s32 max)
+	{
+		if (max < min)
+			throw std::invalid_argument("Invalid range (max < min)");
+		// Larger ranges would be noticeably biased
+		if ((u32)(max - min) > (RANDOM_RANGE + 1) / 5)
+			throw std::invalid_argument("Range too large");
+		return (next() % (max - min + 1)) + min;
+	}
+
+private:
+	s32 m_next;
+};
+
 struct NoiseParams {
 	float offset = 0.0f;
 	float scale = 1.0f;
@@ -46,6 +87,10 @@ struct NoiseParams {
 	float persist = 0.6f;
 	float lacunarity = 2.0f;
 	u32 flags = NOISE_FLAG_DEFAULTS;
+	// With NOISE_FLAG_POINTBUFFER, 3D maps are only evaluated every
+	// point_spacing nodes along each axis, and interpolated in between.
+	// See Noise::pointBufferSpacing
+	u16 point_spacing = 4;
 
 	NoiseParams() = default;
 
@@ -71,27 +116,41 @@ public:
 	u32 sx;
 	u32 sy;
 	u32 sz;
-	float *noise_buf = nullptr;
-	float *gradient_buf = nullptr;
-	float *persist_buf = nullptr;
+	// the only buffer a Noise owns; scratch ones come from NoiseScratch
 	float *result = nullptr;
 
 	Noise(NoiseParams *np, s32 seed, u32 sx, u32 sy, u32 sz=1);
 	~Noise();
 
+	// Only reallocates when growing past the largest size so far
 	void setSize(u32 sx, u32 sy, u32 sz=1);
 	void setSpreadFactor(v3f spread);
 	void setOctaves(int octaves);
 
-	void gradientMap2D(
+	// Fill `out`, of sx * sy (* sz) floats, with one octave
+	void gradientMap2D(float *out,
 		float x, float y,
 		float step_x, float step_y,
 		s32 seed);
-	void gradientMap3D(
+	void gradientMap3D(float *out,
 		float x, float y, float z,
 		float step_x, float step_y, float step_z,
 		s32 seed);
 
+	// Same as gradientMap2D/3D, for NOISE_FLAG_SIMPLEX
+	void simplexMap2D(float *out,
+		float x, float y,
+		float step_x, float step_y,
+		s32 seed);
+	void simplexMap3D(float *out,
+		float x, float y, float z,
+		float step_x, float step_y, float step_z,
+		s32 seed);
+
+	// Spacing NOISE_FLAG_POINTBUFFER actually uses: np.point_spacing, but
+	// not more than the lattice cell of the last octave, which would alias
+	u32 pointBufferSpacing() const;
+
 	float *perlinMap2D(float x, float y, float *persistence_map=NULL);
 	float *perlinMap3D(float x, float y, float z, float *persistence_map=NULL);
 
@@ -115,11 +174,68 @@ public:
 	}
 
 private:
+	// the coarse grid of NOISE_FLAG_POINTBUFFER, created when first used
+	Noise *coarse = nullptr;
+	// floats allocated for result, at least sx * sy * sz
+	size_t result_capacity = 0;
+
 	void allocBuffers();
-	void resizeNoiseBuf(bool is3d);
-	void updateResults(float g, float *gmap, const float *persistence_map,
-			size_t bufsize);
+	void checkLatticeSize();
+	void precomputeColumns(u32 *column_noisex, float *column_tx,
+			float u, float step_x, bool eased);
+	float *pointBufferMap3D(float x, float y, float z);
+	void updateResults(float g, const float *gradient, float *gmap,
+			const float *persistence_map, size_t bufsize);
+
+};
+
+/*
+ * Evaluates several 2D noise maps of the same size in one pass.
+ *
+ * Instead of sweeping the whole map once per octave of every noise, it goes
+ * row by row and accumulates all the octaves of all the noises while the row
+ * is in cache; the lattices and column tables of all the octaves are set up
+ * once per call. The results, left in each Noise::result, are exactly what
+ * perlinMap2D would give. Persistence maps are not supported.
+ */
+class FusedNoise2D {
+public:
+	/// Called with the range of map indices whose results are complete.
+	using RowCallback = std::function<void(u32 begin, u32 end)>;
 
+	/// All the noises must have the same sx and sy, and sz of 1.
+	FusedNoise2D(std::vector<Noise *> noises);
+
+	void perlinMap2D_PO(float x, float xoff, float y, float yoff,
+		const RowCallback &row_done = nullptr);
+
+private:
+	struct Octave {
+		Noise *noise;
+		float g;
+		bool simplex;
+		s32 seed;
+		float x;
+		float step_x;
+		float y;
+		bool eased;
+		u32 nlx;
+		float v;
+		float step_y;
+		u32 noisey;
+		// in NoiseScratch, valid during perlinMap2D_PO
+		float *lattice;
+		u32 *noisex;
+		float *tx;
+	};
+
+	std::vector<Noise *> noises;
+	std::vector<Octave> octaves; // grouped by noise, in the order of noises
+	u32 sx;
+	u32 sy;
+
+	void setupOctave(NoiseScratch::Frame &frame, Octave &o,
+		float x, float y, float f, s32 seed);
 };
 
 float NoisePerlin2D(NoiseParams *np, float x, float y, s32 seed);
@@ -148,9 +264,17 @@ inline float NoisePerlin3D_PO(NoiseParams *np, float x, float xoff,
 float noise2d(int x, int y, s32 seed);
 float noise3d(int x, int y, int z, s32 seed);
 
+// Same as noise2d/noise3d for x, x + 1, ..., x + count - 1, but batched
+void noise2d_row(float *out, u32 count, int x, int y, s32 seed);
+void noise3d_row(float *out, u32 count, int x, int y, int z, s32 seed);
+
 float noise2d_gradient(float x, float y, s32 seed, bool eased=true);
 float noise3d_gradient(float x, float y, float z, s32 seed, bool eased=false);
 
+// Return value: about -1 ... 1
+float noise2d_simplex(float x, float y, s32 seed);
+float noise3d_simplex(float x, float y, float z, s32 seed);
+
 float noise2d_perlin(float x, float y, s32 seed,
 		int octaves, float persistence, bool eased=true);
 
@@ -168,4 +292,11 @@ inline float easeCurve(float t)
 	return t * t * t * (t * (6.f * t - 15.f) + 10.f);
 }
 
-float contour(float v);
+// Inline, as cave generation calls it for every node
+inline float contour(float v)
+{
+	v = std::fabs(v);
+	if (v >= 1.0)
+		return 0.0;
+	return (1.0 - v);
+}
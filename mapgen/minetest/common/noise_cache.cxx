@@ -0,0 +1,112 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "noise_cache.hxx"
+#include <algorithm>
+#include <cstring>
+
+NoiseMapCache::Key::Key(const Noise *noise, float x, float y) :
+	x(x), y(y),
+	sx(noise->sx), sy(noise->sy),
+	seed(noise->seed),
+	offset(noise->np.offset), scale(noise->np.scale),
+	spread_x(noise->np.spread.x), spread_y(noise->np.spread.y),
+	np_seed(noise->np.seed),
+	octaves(noise->np.octaves),
+	persist(noise->np.persist), lacunarity(noise->np.lacunarity),
+	flags(noise->np.flags)
+{
+}
+
+
+bool NoiseMapCache::Key::operator==(const Key &b) const
+{
+	// bitwise, so that equal keys are sure to give equal maps
+	return memcmp(this, &b, sizeof(Key)) == 0;
+}
+
+
+size_t NoiseMapCache::KeyHash::operator()(const Key &key) const
+{
+	static_assert(sizeof(Key) % sizeof(u32) == 0, "Key must have no padding");
+	u32 words[sizeof(Key) / sizeof(u32)];
+	memcpy(words, &key, sizeof(Key));
+	u64 h = 14695981039346656037ULL;
+	for (u32 w : words)
+		h = (h ^ w) * 1099511628211ULL;
+	return h;
+}
+
+
+float *NoiseMapCache::perlinMap2D(Noise *noise, float x, float y)
+{
+	if (fetch(noise, x, y))
+		return noise->result;
+	noise->perlinMap2D(x, y);
+	store(noise, x, y);
+	return noise->result;
+}
+
+
+bool NoiseMapCache::fetch(Noise *noise, float x, float y)
+{
+	Key key(noise, x, y);
+	std::lock_guard<std::mutex> lock(mtx);
+	auto it = index.find(key);
+	if (it == index.end()) {
+		miss_count++;
+		return false;
+	}
+	entries.splice(entries.begin(), entries, it->second);
+	const std::vector<float> &map = it->second->second;
+	std::copy(map.begin(), map.end(), noise->result);
+	hit_count++;
+	return true;
+}
+
+
+void NoiseMapCache::store(const Noise *noise, float x, float y)
+{
+	Key key(noise, x, y);
+	size_t size = noise->sx * noise->sy;
+	std::lock_guard<std::mutex> lock(mtx);
+	if (index.count(key))
+		return; // another thread was faster
+	entries.emplace_front(key, std::vector<float>(noise->result, noise->result + size));
+	index.emplace(key, entries.begin());
+	if (entries.size() > capacity) {
+		index.erase(entries.back().first);
+		entries.pop_back();
+	}
+}
+
+
+float NoiseMapCache::hitRate() const
+{
+	u64 hits = hit_count;
+	u64 total = hits + miss_count;
+	return total ? (float)hits / total : 0.0f;
+}
+
+
+void NoiseMapCache::resetStats()
+{
+	hit_count = 0;
+	miss_count = 0;
+}
@@ -0,0 +1,93 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "noise.hxx"
+
+/*
+ * LRU cache of 2D perlin maps.
+ *
+ * 2D maps depend on the horizontal position only, so all the chunks stacked
+ * in a column can share them. Entries are keyed by everything the result
+ * depends on: the origin, the size, the seed and the noise parameters.
+ * Safe to share between mapgen threads; a map is computed outside of the
+ * lock, so two threads may occasionally compute the same map.
+ */
+class NoiseMapCache {
+public:
+	explicit NoiseMapCache(size_t capacity = 256) : capacity(capacity) {}
+
+	/// Same as noise->perlinMap2D(x, y), but served from the cache if possible.
+	float *perlinMap2D(Noise *noise, float x, float y);
+
+	inline float *perlinMap2D_PO(Noise *noise, float x, float xoff,
+		float y, float yoff)
+	{
+		return perlinMap2D(noise,
+			x + xoff * noise->np.spread.x,
+			y + yoff * noise->np.spread.y);
+	}
+
+	/// Copies the map at x, y into noise->result, if it is cached.
+	bool fetch(Noise *noise, float x, float y);
+
+	/// Caches noise->result as the map at x, y.
+	void store(const Noise *noise, float x, float y);
+
+	u64 hits() const { return hit_count; }
+	u64 misses() const { return miss_count; }
+	float hitRate() const;
+	void resetStats();
+
+private:
+	// All members are 4 bytes wide, so there is no padding to compare or hash
+	struct Key {
+		float x, y;
+		u32 sx, sy;
+		s32 seed;
+		float offset, scale;
+		float spread_x, spread_y;
+		s32 np_seed;
+		u32 octaves;
+		float persist, lacunarity;
+		u32 flags;
+
+		Key(const Noise *noise, float x, float y);
+		bool operator==(const Key &b) const;
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key &key) const;
+	};
+
+	using Entry = std::pair<Key, std::vector<float>>;
+
+	const size_t capacity;
+	std::mutex mtx;
+	std::list<Entry> entries; // most recently used first
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+	std::atomic<u64> hit_count{0};
+	std::atomic<u64> miss_count{0};
+};
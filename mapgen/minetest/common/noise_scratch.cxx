@@ -0,0 +1,107 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "noise_scratch.hxx"
+#include <algorithm>
+#include <new>
+
+static constexpr size_t min_block_size = 64 * 1024;
+
+
+NoiseScratch::Frame::Frame() :
+	scratch(NoiseScratch::local()),
+	block(scratch.current),
+	top(scratch.top)
+{
+	scratch.depth++;
+}
+
+
+NoiseScratch::Frame::~Frame()
+{
+	scratch.release(block, top);
+}
+
+
+NoiseScratch &NoiseScratch::local()
+{
+	static thread_local NoiseScratch scratch;
+	return scratch;
+}
+
+
+NoiseScratch::~NoiseScratch()
+{
+	freeBlocks();
+}
+
+
+size_t NoiseScratch::capacity() const
+{
+	size_t total = 0;
+	for (const Block &b : blocks)
+		total += b.size;
+	return total;
+}
+
+
+void *NoiseScratch::alloc(size_t size)
+{
+	size = (size + alignment - 1) & ~(alignment - 1);
+	// skip to a block that has room, adding one if there is none
+	while (current < blocks.size() && top + size > blocks[current].size) {
+		current++;
+		top = 0;
+	}
+	if (current == blocks.size())
+		addBlock(std::max(size, blocks.empty() ? min_block_size : 2 * blocks.back().size));
+	void *p = blocks[current].data + top;
+	top += size;
+	return p;
+}
+
+
+void NoiseScratch::release(size_t block, size_t top)
+{
+	current = block;
+	this->top = top;
+	if (--depth || blocks.size() < 2)
+		return;
+	// nothing is in use now, so the blocks can be merged
+	size_t size = capacity();
+	freeBlocks();
+	addBlock(size);
+}
+
+
+void NoiseScratch::addBlock(size_t size)
+{
+	char *data = static_cast<char *>(::operator new(size, std::align_val_t(alignment)));
+	blocks.push_back({data, size});
+}
+
+
+void NoiseScratch::freeBlocks()
+{
+	for (const Block &b : blocks)
+		::operator delete(b.data, std::align_val_t(alignment));
+	blocks.clear();
+	current = 0;
+	top = 0;
+}
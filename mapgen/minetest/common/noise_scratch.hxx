@@ -0,0 +1,88 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Per-thread scratch memory of the noise code.
+ *
+ * Lattices, gradient maps and column tables are only needed while a map is
+ * being computed, so instead of every Noise owning its own, they are taken
+ * from the arena of the calling thread and given back when the call returns.
+ * All the noises on a thread thus share the same few cache-aligned blocks,
+ * sized for the largest of them.
+ *
+ * Memory is handed out stack-wise: everything allocated through a Frame is
+ * released when that Frame goes out of scope, and frames may nest (a Noise
+ * may use another Noise while it holds its buffers). If a request does not
+ * fit, a new block is added; once the outermost frame is released, the
+ * blocks are merged, so after the first few maps there is a single block
+ * and no allocation at all.
+ */
+class NoiseScratch {
+public:
+	static constexpr size_t alignment = 64; // a cache line
+
+	class Frame {
+	public:
+		Frame();
+		~Frame();
+		Frame(const Frame &) = delete;
+		Frame &operator=(const Frame &) = delete;
+
+		template <typename T>
+		T *alloc(size_t count)
+		{
+			return static_cast<T *>(scratch.alloc(count * sizeof(T)));
+		}
+
+	private:
+		NoiseScratch &scratch;
+		size_t block;
+		size_t top;
+	};
+
+	/// Arena of the calling thread.
+	static NoiseScratch &local();
+
+	/// Bytes reserved by this arena.
+	size_t capacity() const;
+
+	~NoiseScratch();
+
+private:
+	struct Block {
+		char *data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t current = 0; // index of the block being allocated from
+	size_t top = 0; // bytes used in it
+	unsigned depth = 0; // number of live frames
+
+	NoiseScratch() = default;
+	void *alloc(size_t size);
+	void release(size_t block, size_t top);
+	void addBlock(size_t size);
+	void freeBlocks();
+};
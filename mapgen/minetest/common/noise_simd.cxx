@@ -0,0 +1,981 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "noise_simd.hxx"
+#include <cmath>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define NOISE_SIMD_X86 1
+#endif
+
+/*
+ * NB: the kernels must stay free of FMA. The AVX2 ones are compiled for
+ * "avx2" only, so the compiler can't contract a multiply and an add even
+ * with -ffp-contract=fast, which keeps the results equal to the scalar ones.
+ */
+
+static inline float lerp(float v0, float v1, float t)
+{
+	return v0 + (v1 - v0) * t;
+}
+
+
+static void gradientRow2D_scalar(float *out, u32 count,
+		const float *r0, const float *r1,
+		const u32 *noisex, const float *tx, float ty)
+{
+	for (u32 i = 0; i != count; i++) {
+		u32 n = noisex[i];
+		float u = lerp(r0[n], r0[n + 1], tx[i]);
+		float v = lerp(r1[n], r1[n + 1], tx[i]);
+		out[i] = lerp(u, v, ty);
+	}
+}
+
+
+static void gradientRow3D_scalar(float *out, u32 count,
+		const float *r00, const float *r10,
+		const float *r01, const float *r11,
+		const u32 *noisex, const float *tx, float ty, float tz)
+{
+	for (u32 i = 0; i != count; i++) {
+		u32 n = noisex[i];
+		float u0 = lerp(r00[n], r00[n + 1], tx[i]);
+		float v0 = lerp(r10[n], r10[n + 1], tx[i]);
+		float u1 = lerp(r01[n], r01[n + 1], tx[i]);
+		float v1 = lerp(r11[n], r11[n + 1], tx[i]);
+		out[i] = lerp(lerp(u0, v0, ty), lerp(u1, v1, ty), tz);
+	}
+}
+
+
+static inline u32 latticeHash(u32 n)
+{
+	n &= 0x7fffffff;
+	n = (n >> 13) ^ n;
+	return (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
+}
+
+
+static inline float latticeValue(u32 n)
+{
+	return 1.f - (float)(int)latticeHash(n) / 0x40000000;
+}
+
+
+static void latticeRow_scalar(float *out, u32 count, u32 n0, u32 step)
+{
+	for (u32 i = 0; i != count; i++, n0 += step)
+		out[i] = latticeValue(n0);
+}
+
+
+/*
+ * Simplex noise. Every sample hashes the corners of its simplex, so the hash
+ * is much cheaper than latticeHash: the corner coordinates, each multiplied
+ * by a large prime, are xored together with the seed and mixed with a single
+ * multiplication. The vectored variants below mirror these functions
+ * operation by operation, so keep them in sync.
+ */
+
+static const u32 PRIME_X = 501125321;
+static const u32 PRIME_Y = 1136930381;
+static const u32 PRIME_Z = 1720413743;
+
+static const float SIMPLEX_F2 = 0.36602540f; // (sqrt(3) - 1) / 2
+static const float SIMPLEX_G2 = 0.21132487f; // (3 - sqrt(3)) / 6
+static const float SIMPLEX_F3 = 1.f / 3.f;
+static const float SIMPLEX_G3 = 1.f / 6.f;
+
+// Chosen so that the results are roughly within -1 ... 1
+static const float SIMPLEX_SCALE2 = 40.f;
+static const float SIMPLEX_SCALE3 = 32.f;
+
+
+static inline u32 simplexHash(u32 n)
+{
+	n *= 0x27d4eb2d;
+	return n ^ (n >> 15);
+}
+
+
+// One of 8 directions
+static inline float simplexGrad2(u32 hash, float x, float y)
+{
+	u32 h = hash & 7;
+	float u = h < 4 ? x : y;
+	float v = h < 4 ? y : x;
+	v = 2.f * v;
+	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+
+// One of the 12 cube edge directions, 4 of them twice
+static inline float simplexGrad3(u32 hash, float x, float y, float z)
+{
+	u32 h = hash & 15;
+	float u = h < 8 ? x : y;
+	float v = h < 4 ? y : (h | 2) == 14 ? x : z;
+	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+
+static inline float simplexFalloff(float t)
+{
+	t = t > 0.f ? t : 0.f;
+	t = t * t;
+	return t * t;
+}
+
+
+static inline float simplex2D(float x, float y, u32 seed)
+{
+	float s = (x + y) * SIMPLEX_F2;
+	s32 i = std::floor(x + s);
+	s32 j = std::floor(y + s);
+	float t = (float)(i + j) * SIMPLEX_G2;
+	float x0 = x - ((float)i - t);
+	float y0 = y - ((float)j - t);
+
+	// lower or upper triangle of the skewed cell
+	u32 i1 = x0 > y0;
+	u32 j1 = !i1;
+
+	float x1 = x0 - (float)i1 + SIMPLEX_G2;
+	float y1 = y0 - (float)j1 + SIMPLEX_G2;
+	float x2 = x0 - 1.f + 2.f * SIMPLEX_G2;
+	float y2 = y0 - 1.f + 2.f * SIMPLEX_G2;
+
+	u32 xp = PRIME_X * i;
+	u32 yp = PRIME_Y * j;
+	float n0 = simplexFalloff(0.5f - x0 * x0 - y0 * y0) *
+		simplexGrad2(simplexHash(xp ^ yp ^ seed), x0, y0);
+	float n1 = simplexFalloff(0.5f - x1 * x1 - y1 * y1) *
+		simplexGrad2(simplexHash((xp + PRIME_X * i1) ^ (yp + PRIME_Y * j1) ^ seed),
+			x1, y1);
+	float n2 = simplexFalloff(0.5f - x2 * x2 - y2 * y2) *
+		simplexGrad2(simplexHash((xp + PRIME_X) ^ (yp + PRIME_Y) ^ seed), x2, y2);
+	return SIMPLEX_SCALE2 * (n0 + n1 + n2);
+}
+
+
+static inline float simplex3D(float x, float y, float z, u32 seed)
+{
+	float s = (x + y + z) * SIMPLEX_F3;
+	s32 i = std::floor(x + s);
+	s32 j = std::floor(y + s);
+	s32 k = std::floor(z + s);
+	float t = (float)(i + j + k) * SIMPLEX_G3;
+	float x0 = x - ((float)i - t);
+	float y0 = y - ((float)j - t);
+	float z0 = z - ((float)k - t);
+
+	// which of the 6 tetrahedra of the skewed cell
+	bool xy = x0 >= y0;
+	bool xz = x0 >= z0;
+	bool yz = y0 >= z0;
+	u32 i1 = xy && xz;
+	u32 j1 = !xy && yz;
+	u32 k1 = !xz && !yz;
+	u32 i2 = xy || xz;
+	u32 j2 = !xy || yz;
+	u32 k2 = !(xz && yz);
+
+	float x1 = x0 - (float)i1 + SIMPLEX_G3;
+	float y1 = y0 - (float)j1 + SIMPLEX_G3;
+	float z1 = z0 - (float)k1 + SIMPLEX_G3;
+	float x2 = x0 - (float)i2 + 2.f * SIMPLEX_G3;
+	float y2 = y0 - (float)j2 + 2.f * SIMPLEX_G3;
+	float z2 = z0 - (float)k2 + 2.f * SIMPLEX_G3;
+	float x3 = x0 - 1.f + 3.f * SIMPLEX_G3;
+	float y3 = y0 - 1.f + 3.f * SIMPLEX_G3;
+	float z3 = z0 - 1.f + 3.f * SIMPLEX_G3;
+
+	u32 xp = PRIME_X * i;
+	u32 yp = PRIME_Y * j;
+	u32 zp = PRIME_Z * k;
+	float n0 = simplexFalloff(0.6f - x0 * x0 - y0 * y0 - z0 * z0) *
+		simplexGrad3(simplexHash(xp ^ yp ^ zp ^ seed), x0, y0, z0);
+	float n1 = simplexFalloff(0.6f - x1 * x1 - y1 * y1 - z1 * z1) *
+		simplexGrad3(simplexHash((xp + PRIME_X * i1) ^ (yp + PRIME_Y * j1) ^
+			(zp + PRIME_Z * k1) ^ seed), x1, y1, z1);
+	float n2 = simplexFalloff(0.6f - x2 * x2 - y2 * y2 - z2 * z2) *
+		simplexGrad3(simplexHash((xp + PRIME_X * i2) ^ (yp + PRIME_Y * j2) ^
+			(zp + PRIME_Z * k2) ^ seed), x2, y2, z2);
+	float n3 = simplexFalloff(0.6f - x3 * x3 - y3 * y3 - z3 * z3) *
+		simplexGrad3(simplexHash((xp + PRIME_X) ^ (yp + PRIME_Y) ^
+			(zp + PRIME_Z) ^ seed), x3, y3, z3);
+	return SIMPLEX_SCALE3 * (n0 + n1 + n2 + n3);
+}
+
+
+// Points begin ... count - 1 of the row, so that the vectored kernels can
+// finish a row here
+static void simplexRow2D_from(float *out, u32 begin, u32 count,
+		float x, float step_x, float y, s32 seed)
+{
+	for (u32 i = begin; i != count; i++)
+		out[i] = simplex2D(x + (float)i * step_x, y, seed);
+}
+
+
+static void simplexRow3D_from(float *out, u32 begin, u32 count,
+		float x, float step_x, float y, float z, s32 seed)
+{
+	for (u32 i = begin; i != count; i++)
+		out[i] = simplex3D(x + (float)i * step_x, y, z, seed);
+}
+
+
+static void simplexRow2D_scalar(float *out, u32 count,
+		float x, float step_x, float y, s32 seed)
+{
+	simplexRow2D_from(out, 0, count, x, step_x, y, seed);
+}
+
+
+static void simplexRow3D_scalar(float *out, u32 count,
+		float x, float step_x, float y, float z, s32 seed)
+{
+	simplexRow3D_from(out, 0, count, x, step_x, y, z, seed);
+}
+
+
+#if NOISE_SIMD_X86
+
+///////////////////////////////// [ SSE2 ] ////////////////////////////////
+// SSE2 is a part of x86-64, so these need no runtime check. Without gathers,
+// the lattice values are loaded one by one; only the arithmetic is vectored.
+
+static inline __m128 lerp4(__m128 v0, __m128 v1, __m128 t)
+{
+	return _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), t));
+}
+
+
+static inline __m128 load4(const float *r, const u32 *n)
+{
+	return _mm_setr_ps(r[n[0]], r[n[1]], r[n[2]], r[n[3]]);
+}
+
+
+static void gradientRow2D_sse2(float *out, u32 count,
+		const float *r0, const float *r1,
+		const u32 *noisex, const float *tx, float ty)
+{
+	const __m128 vty = _mm_set1_ps(ty);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const u32 *n = noisex + i;
+		__m128 t = _mm_loadu_ps(tx + i);
+		__m128 u = lerp4(load4(r0, n), load4(r0 + 1, n), t);
+		__m128 v = lerp4(load4(r1, n), load4(r1 + 1, n), t);
+		_mm_storeu_ps(out + i, lerp4(u, v, vty));
+	}
+	gradientRow2D_scalar(out + i, count - i, r0, r1, noisex + i, tx + i, ty);
+}
+
+
+static void gradientRow3D_sse2(float *out, u32 count,
+		const float *r00, const float *r10,
+		const float *r01, const float *r11,
+		const u32 *noisex, const float *tx, float ty, float tz)
+{
+	const __m128 vty = _mm_set1_ps(ty);
+	const __m128 vtz = _mm_set1_ps(tz);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const u32 *n = noisex + i;
+		__m128 t = _mm_loadu_ps(tx + i);
+		__m128 u0 = lerp4(load4(r00, n), load4(r00 + 1, n), t);
+		__m128 v0 = lerp4(load4(r10, n), load4(r10 + 1, n), t);
+		__m128 u1 = lerp4(load4(r01, n), load4(r01 + 1, n), t);
+		__m128 v1 = lerp4(load4(r11, n), load4(r11 + 1, n), t);
+		_mm_storeu_ps(out + i, lerp4(lerp4(u0, v0, vty), lerp4(u1, v1, vty), vtz));
+	}
+	gradientRow3D_scalar(out + i, count - i, r00, r10, r01, r11,
+		noisex + i, tx + i, ty, tz);
+}
+
+
+/////////////////////////////// [ SSE4.1 ] ///////////////////////////////
+// Needed for the 32-bit multiply, pmulld, and for roundps and blendvps.
+
+#define SSE41 __attribute__((target("sse4.1")))
+
+SSE41 static inline __m128i latticeHash4(__m128i n)
+{
+	const __m128i mask = _mm_set1_epi32(0x7fffffff);
+	n = _mm_and_si128(n, mask);
+	n = _mm_xor_si128(_mm_srli_epi32(n, 13), n);
+	__m128i m = _mm_mullo_epi32(n, n);
+	m = _mm_add_epi32(_mm_mullo_epi32(m, _mm_set1_epi32(60493)), _mm_set1_epi32(19990303));
+	m = _mm_add_epi32(_mm_mullo_epi32(n, m), _mm_set1_epi32(1376312589));
+	return _mm_and_si128(m, mask);
+}
+
+
+SSE41 static inline __m128 latticeValue4(__m128i n)
+{
+	return _mm_sub_ps(_mm_set1_ps(1.f),
+		_mm_div_ps(_mm_cvtepi32_ps(latticeHash4(n)), _mm_set1_ps(0x40000000)));
+}
+
+
+SSE41 static void latticeRow_sse41(float *out, u32 count, u32 n0, u32 step)
+{
+	__m128i n = _mm_add_epi32(_mm_set1_epi32(n0),
+		_mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(step)));
+	const __m128i advance = _mm_set1_epi32(4 * step);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(out + i, latticeValue4(n));
+		n = _mm_add_epi32(n, advance);
+	}
+	latticeRow_scalar(out + i, count - i, n0 + i * step, step);
+}
+
+
+// Masks are all ones or all zeroes, like the results of comparisons
+
+SSE41 static inline __m128i simplexHash4(__m128i n)
+{
+	n = _mm_mullo_epi32(n, _mm_set1_epi32(0x27d4eb2d));
+	return _mm_xor_si128(n, _mm_srli_epi32(n, 15));
+}
+
+
+SSE41 static inline __m128 flipSign4(__m128 v, __m128i h, int bit)
+{
+	// moves the bit into the sign bit
+	__m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1 << bit)), 31 - bit);
+	return _mm_xor_ps(v, _mm_castsi128_ps(sign));
+}
+
+
+SSE41 static inline __m128 lessThan4(__m128i h, int value)
+{
+	return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(value), h));
+}
+
+
+SSE41 static inline __m128 simplexGrad2_4(__m128i hash, __m128 x, __m128 y)
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+	__m128 lt4 = lessThan4(h, 4);
+	__m128 u = _mm_blendv_ps(y, x, lt4);
+	__m128 v = _mm_blendv_ps(x, y, lt4);
+	v = _mm_mul_ps(_mm_set1_ps(2.f), v);
+	return _mm_add_ps(flipSign4(u, h, 0), flipSign4(v, h, 1));
+}
+
+
+SSE41 static inline __m128 simplexGrad3_4(__m128i hash, __m128 x, __m128 y, __m128 z)
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+	__m128 is14 = _mm_castsi128_ps(_mm_cmpeq_epi32(
+		_mm_or_si128(h, _mm_set1_epi32(2)), _mm_set1_epi32(14)));
+	__m128 u = _mm_blendv_ps(y, x, lessThan4(h, 8));
+	__m128 v = _mm_blendv_ps(_mm_blendv_ps(z, x, is14), y, lessThan4(h, 4));
+	return _mm_add_ps(flipSign4(u, h, 0), flipSign4(v, h, 1));
+}
+
+
+SSE41 static inline __m128 simplexFalloff4(__m128 t)
+{
+	t = _mm_max_ps(t, _mm_setzero_ps());
+	t = _mm_mul_ps(t, t);
+	return _mm_mul_ps(t, t);
+}
+
+
+// prime where the mask is set, 0 elsewhere
+SSE41 static inline __m128i cornerStep4(__m128 mask, __m128i prime)
+{
+	return _mm_and_si128(_mm_castps_si128(mask), prime);
+}
+
+
+// 1 where the mask is set, 0 elsewhere
+SSE41 static inline __m128 cornerOffset4(__m128 mask)
+{
+	return _mm_and_ps(mask, _mm_set1_ps(1.f));
+}
+
+
+SSE41 static inline __m128 square4(__m128 v)
+{
+	return _mm_mul_ps(v, v);
+}
+
+
+SSE41 static inline __m128i xor4(__m128i a, __m128i b)
+{
+	return _mm_xor_si128(a, b);
+}
+
+
+SSE41 static inline __m128 simplex2D_4(__m128 x, __m128 y, __m128i seed)
+{
+	const __m128 ones = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	__m128 s = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(SIMPLEX_F2));
+	__m128i i = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(x, s)));
+	__m128i j = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(y, s)));
+	__m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), _mm_set1_ps(SIMPLEX_G2));
+	__m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+	__m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+
+	__m128 i1 = _mm_cmpgt_ps(x0, y0);
+	__m128 j1 = _mm_andnot_ps(i1, ones);
+
+	const __m128 g1 = _mm_set1_ps(SIMPLEX_G2);
+	const __m128 g2 = _mm_set1_ps(2.f * SIMPLEX_G2);
+	const __m128 one = _mm_set1_ps(1.f);
+	__m128 x1 = _mm_add_ps(_mm_sub_ps(x0, cornerOffset4(i1)), g1);
+	__m128 y1 = _mm_add_ps(_mm_sub_ps(y0, cornerOffset4(j1)), g1);
+	__m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), g2);
+	__m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), g2);
+
+	const __m128i px = _mm_set1_epi32(PRIME_X);
+	const __m128i py = _mm_set1_epi32(PRIME_Y);
+	__m128i xp = _mm_mullo_epi32(i, px);
+	__m128i yp = _mm_mullo_epi32(j, py);
+	__m128i n0 = xor4(xor4(xp, yp), seed);
+	__m128i n1 = xor4(xor4(_mm_add_epi32(xp, cornerStep4(i1, px)),
+		_mm_add_epi32(yp, cornerStep4(j1, py))), seed);
+	__m128i n2 = xor4(xor4(_mm_add_epi32(xp, px), _mm_add_epi32(yp, py)), seed);
+
+	const __m128 r = _mm_set1_ps(0.5f);
+	__m128 c0 = _mm_mul_ps(
+		simplexFalloff4(_mm_sub_ps(_mm_sub_ps(r, square4(x0)), square4(y0))),
+		simplexGrad2_4(simplexHash4(n0), x0, y0));
+	__m128 c1 = _mm_mul_ps(
+		simplexFalloff4(_mm_sub_ps(_mm_sub_ps(r, square4(x1)), square4(y1))),
+		simplexGrad2_4(simplexHash4(n1), x1, y1));
+	__m128 c2 = _mm_mul_ps(
+		simplexFalloff4(_mm_sub_ps(_mm_sub_ps(r, square4(x2)), square4(y2))),
+		simplexGrad2_4(simplexHash4(n2), x2, y2));
+	return _mm_mul_ps(_mm_set1_ps(SIMPLEX_SCALE2),
+		_mm_add_ps(_mm_add_ps(c0, c1), c2));
+}
+
+
+SSE41 static inline __m128 simplex3D_4(__m128 x, __m128 y, __m128 z, __m128i seed)
+{
+	const __m128 ones = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	__m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, y), z), _mm_set1_ps(SIMPLEX_F3));
+	__m128i i = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(x, s)));
+	__m128i j = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(y, s)));
+	__m128i k = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(z, s)));
+	__m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(i, j), k)),
+		_mm_set1_ps(SIMPLEX_G3));
+	__m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+	__m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+	__m128 z0 = _mm_sub_ps(z, _mm_sub_ps(_mm_cvtepi32_ps(k), t));
+
+	__m128 xy = _mm_cmpge_ps(x0, y0);
+	__m128 xz = _mm_cmpge_ps(x0, z0);
+	__m128 yz = _mm_cmpge_ps(y0, z0);
+	__m128 i1 = _mm_and_ps(xy, xz);
+	__m128 j1 = _mm_andnot_ps(xy, yz);
+	__m128 k1 = _mm_andnot_ps(_mm_or_ps(xz, yz), ones);
+	__m128 i2 = _mm_or_ps(xy, xz);
+	__m128 j2 = _mm_or_ps(_mm_andnot_ps(xy, ones), yz);
+	__m128 k2 = _mm_andnot_ps(_mm_and_ps(xz, yz), ones);
+
+	const __m128 g1 = _mm_set1_ps(SIMPLEX_G3);
+	const __m128 g2 = _mm_set1_ps(2.f * SIMPLEX_G3);
+	const __m128 g3 = _mm_set1_ps(3.f * SIMPLEX_G3);
+	const __m128 one = _mm_set1_ps(1.f);
+	__m128 x1 = _mm_add_ps(_mm_sub_ps(x0, cornerOffset4(i1)), g1);
+	__m128 y1 = _mm_add_ps(_mm_sub_ps(y0, cornerOffset4(j1)), g1);
+	__m128 z1 = _mm_add_ps(_mm_sub_ps(z0, cornerOffset4(k1)), g1);
+	__m128 x2 = _mm_add_ps(_mm_sub_ps(x0, cornerOffset4(i2)), g2);
+	__m128 y2 = _mm_add_ps(_mm_sub_ps(y0, cornerOffset4(j2)), g2);
+	__m128 z2 = _mm_add_ps(_mm_sub_ps(z0, cornerOffset4(k2)), g2);
+	__m128 x3 = _mm_add_ps(_mm_sub_ps(x0, one), g3);
+	__m128 y3 = _mm_add_ps(_mm_sub_ps(y0, one), g3);
+	__m128 z3 = _mm_add_ps(_mm_sub_ps(z0, one), g3);
+
+	const __m128i px = _mm_set1_epi32(PRIME_X);
+	const __m128i py = _mm_set1_epi32(PRIME_Y);
+	const __m128i pz = _mm_set1_epi32(PRIME_Z);
+	__m128i xp = _mm_mullo_epi32(i, px);
+	__m128i yp = _mm_mullo_epi32(j, py);
+	__m128i zp = _mm_mullo_epi32(k, pz);
+	__m128i n0 = xor4(xor4(xor4(xp, yp), zp), seed);
+	__m128i n1 = xor4(xor4(xor4(_mm_add_epi32(xp, cornerStep4(i1, px)),
+		_mm_add_epi32(yp, cornerStep4(j1, py))),
+		_mm_add_epi32(zp, cornerStep4(k1, pz))), seed);
+	__m128i n2 = xor4(xor4(xor4(_mm_add_epi32(xp, cornerStep4(i2, px)),
+		_mm_add_epi32(yp, cornerStep4(j2, py))),
+		_mm_add_epi32(zp, cornerStep4(k2, pz))), seed);
+	__m128i n3 = xor4(xor4(xor4(_mm_add_epi32(xp, px),
+		_mm_add_epi32(yp, py)), _mm_add_epi32(zp, pz)), seed);
+
+	const __m128 r = _mm_set1_ps(0.6f);
+	__m128 c0 = _mm_mul_ps(simplexFalloff4(_mm_sub_ps(_mm_sub_ps(_mm_sub_ps(r,
+		square4(x0)), square4(y0)), square4(z0))),
+		simplexGrad3_4(simplexHash4(n0), x0, y0, z0));
+	__m128 c1 = _mm_mul_ps(simplexFalloff4(_mm_sub_ps(_mm_sub_ps(_mm_sub_ps(r,
+		square4(x1)), square4(y1)), square4(z1))),
+		simplexGrad3_4(simplexHash4(n1), x1, y1, z1));
+	__m128 c2 = _mm_mul_ps(simplexFalloff4(_mm_sub_ps(_mm_sub_ps(_mm_sub_ps(r,
+		square4(x2)), square4(y2)), square4(z2))),
+		simplexGrad3_4(simplexHash4(n2), x2, y2, z2));
+	__m128 c3 = _mm_mul_ps(simplexFalloff4(_mm_sub_ps(_mm_sub_ps(_mm_sub_ps(r,
+		square4(x3)), square4(y3)), square4(z3))),
+		simplexGrad3_4(simplexHash4(n3), x3, y3, z3));
+	return _mm_mul_ps(_mm_set1_ps(SIMPLEX_SCALE3),
+		_mm_add_ps(_mm_add_ps(_mm_add_ps(c0, c1), c2), c3));
+}
+
+
+// x of points i ... i + 3 of a row
+SSE41 static inline __m128 rowX4(float x, float step_x, u32 i)
+{
+	__m128 k = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), _mm_setr_epi32(0, 1, 2, 3)));
+	return _mm_add_ps(_mm_set1_ps(x), _mm_mul_ps(k, _mm_set1_ps(step_x)));
+}
+
+
+SSE41 static void simplexRow2D_sse41(float *out, u32 count,
+		float x, float step_x, float y, s32 seed)
+{
+	const __m128 vy = _mm_set1_ps(y);
+	const __m128i vseed = _mm_set1_epi32(seed);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, simplex2D_4(rowX4(x, step_x, i), vy, vseed));
+	simplexRow2D_from(out, i, count, x, step_x, y, seed);
+}
+
+
+SSE41 static void simplexRow3D_sse41(float *out, u32 count,
+		float x, float step_x, float y, float z, s32 seed)
+{
+	const __m128 vy = _mm_set1_ps(y);
+	const __m128 vz = _mm_set1_ps(z);
+	const __m128i vseed = _mm_set1_epi32(seed);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, simplex3D_4(rowX4(x, step_x, i), vy, vz, vseed));
+	simplexRow3D_from(out, i, count, x, step_x, y, z, seed);
+}
+
+
+#undef SSE41
+
+
+///////////////////////////////// [ AVX2 ] ////////////////////////////////
+
+// The callers are SSE code, so each kernel clears the upper halves of the
+// registers when done: GCC doesn't always do that for target("avx2").
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256 lerp8(__m256 v0, __m256 v1, __m256 t)
+{
+	return _mm256_add_ps(v0, _mm256_mul_ps(_mm256_sub_ps(v1, v0), t));
+}
+
+
+/*
+ * Gathers are slow on many CPUs, so lattice values are fetched differently.
+ * When the 8 columns span at most 8 lattice cells, which is the case unless
+ * the lattice is finer than the map, a lattice row segment is loaded at once
+ * and then permuted into place; otherwise values are loaded one by one.
+ */
+struct Lanes8 {
+	__m256i perm; // column cell index relative to base
+	u32 base;     // first cell index
+	bool packed;  // whether perm can be used
+};
+
+
+AVX2 static inline Lanes8 lanes8(const u32 *n, u32 last)
+{
+	Lanes8 l;
+	l.base = n[0];
+	l.packed = n[7] - n[0] < 8 && n[0] + 8 <= last;
+	l.perm = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)n),
+		_mm256_set1_epi32(n[0]));
+	return l;
+}
+
+
+/// r[n[k]] for each lane k
+AVX2 static inline __m256 load8(const float *r, const u32 *n, const Lanes8 &l)
+{
+	if (l.packed)
+		return _mm256_permutevar8x32_ps(_mm256_loadu_ps(r + l.base), l.perm);
+	return _mm256_setr_ps(r[n[0]], r[n[1]], r[n[2]], r[n[3]],
+		r[n[4]], r[n[5]], r[n[6]], r[n[7]]);
+}
+
+
+AVX2 static void gradientRow2D_avx2(float *out, u32 count,
+		const float *r0, const float *r1,
+		const u32 *noisex, const float *tx, float ty)
+{
+	if (!count)
+		return;
+	const u32 last = noisex[count - 1] + 1; // rightmost lattice value read
+	const __m256 vty = _mm256_set1_ps(ty);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const u32 *n = noisex + i;
+		Lanes8 l = lanes8(n, last);
+		__m256 t = _mm256_loadu_ps(tx + i);
+		__m256 u = lerp8(load8(r0, n, l), load8(r0 + 1, n, l), t);
+		__m256 v = lerp8(load8(r1, n, l), load8(r1 + 1, n, l), t);
+		_mm256_storeu_ps(out + i, lerp8(u, v, vty));
+	}
+	_mm256_zeroupper();
+	gradientRow2D_scalar(out + i, count - i, r0, r1, noisex + i, tx + i, ty);
+}
+
+
+AVX2 static void gradientRow3D_avx2(float *out, u32 count,
+		const float *r00, const float *r10,
+		const float *r01, const float *r11,
+		const u32 *noisex, const float *tx, float ty, float tz)
+{
+	if (!count)
+		return;
+	const u32 last = noisex[count - 1] + 1; // rightmost lattice value read
+	const __m256 vty = _mm256_set1_ps(ty);
+	const __m256 vtz = _mm256_set1_ps(tz);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const u32 *n = noisex + i;
+		Lanes8 l = lanes8(n, last);
+		__m256 t = _mm256_loadu_ps(tx + i);
+		__m256 u0 = lerp8(load8(r00, n, l), load8(r00 + 1, n, l), t);
+		__m256 v0 = lerp8(load8(r10, n, l), load8(r10 + 1, n, l), t);
+		__m256 u1 = lerp8(load8(r01, n, l), load8(r01 + 1, n, l), t);
+		__m256 v1 = lerp8(load8(r11, n, l), load8(r11 + 1, n, l), t);
+		_mm256_storeu_ps(out + i, lerp8(lerp8(u0, v0, vty), lerp8(u1, v1, vty), vtz));
+	}
+	_mm256_zeroupper();
+	gradientRow3D_scalar(out + i, count - i, r00, r10, r01, r11,
+		noisex + i, tx + i, ty, tz);
+}
+
+
+AVX2 static inline __m256i latticeHash8(__m256i n)
+{
+	const __m256i mask = _mm256_set1_epi32(0x7fffffff);
+	n = _mm256_and_si256(n, mask);
+	n = _mm256_xor_si256(_mm256_srli_epi32(n, 13), n);
+	__m256i m = _mm256_mullo_epi32(n, n);
+	m = _mm256_add_epi32(_mm256_mullo_epi32(m, _mm256_set1_epi32(60493)), _mm256_set1_epi32(19990303));
+	m = _mm256_add_epi32(_mm256_mullo_epi32(n, m), _mm256_set1_epi32(1376312589));
+	return _mm256_and_si256(m, mask);
+}
+
+
+AVX2 static inline __m256 latticeValue8(__m256i n)
+{
+	return _mm256_sub_ps(_mm256_set1_ps(1.f),
+		_mm256_div_ps(_mm256_cvtepi32_ps(latticeHash8(n)), _mm256_set1_ps(0x40000000)));
+}
+
+
+AVX2 static void latticeRow_avx2(float *out, u32 count, u32 n0, u32 step)
+{
+	__m256i n = _mm256_add_epi32(_mm256_set1_epi32(n0),
+		_mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step)));
+	const __m256i advance = _mm256_set1_epi32(8 * step);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(out + i, latticeValue8(n));
+		n = _mm256_add_epi32(n, advance);
+	}
+	_mm256_zeroupper();
+	latticeRow_scalar(out + i, count - i, n0 + i * step, step);
+}
+
+
+AVX2 static inline __m256i simplexHash8(__m256i n)
+{
+	n = _mm256_mullo_epi32(n, _mm256_set1_epi32(0x27d4eb2d));
+	return _mm256_xor_si256(n, _mm256_srli_epi32(n, 15));
+}
+
+
+AVX2 static inline __m256 flipSign8(__m256 v, __m256i h, int bit)
+{
+	// moves the bit into the sign bit
+	__m256i sign = _mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1 << bit)), 31 - bit);
+	return _mm256_xor_ps(v, _mm256_castsi256_ps(sign));
+}
+
+
+AVX2 static inline __m256 lessThan8(__m256i h, int value)
+{
+	return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(value), h));
+}
+
+
+AVX2 static inline __m256 simplexGrad2_8(__m256i hash, __m256 x, __m256 y)
+{
+	__m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(7));
+	__m256 lt4 = lessThan8(h, 4);
+	__m256 u = _mm256_blendv_ps(y, x, lt4);
+	__m256 v = _mm256_blendv_ps(x, y, lt4);
+	v = _mm256_mul_ps(_mm256_set1_ps(2.f), v);
+	return _mm256_add_ps(flipSign8(u, h, 0), flipSign8(v, h, 1));
+}
+
+
+AVX2 static inline __m256 simplexGrad3_8(__m256i hash, __m256 x, __m256 y, __m256 z)
+{
+	__m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+	__m256 is14 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+		_mm256_or_si256(h, _mm256_set1_epi32(2)), _mm256_set1_epi32(14)));
+	__m256 u = _mm256_blendv_ps(y, x, lessThan8(h, 8));
+	__m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, is14), y, lessThan8(h, 4));
+	return _mm256_add_ps(flipSign8(u, h, 0), flipSign8(v, h, 1));
+}
+
+
+AVX2 static inline __m256 simplexFalloff8(__m256 t)
+{
+	t = _mm256_max_ps(t, _mm256_setzero_ps());
+	t = _mm256_mul_ps(t, t);
+	return _mm256_mul_ps(t, t);
+}
+
+
+// prime where the mask is set, 0 elsewhere
+AVX2 static inline __m256i cornerStep8(__m256 mask, __m256i prime)
+{
+	return _mm256_and_si256(_mm256_castps_si256(mask), prime);
+}
+
+
+// 1 where the mask is set, 0 elsewhere
+AVX2 static inline __m256 cornerOffset8(__m256 mask)
+{
+	return _mm256_and_ps(mask, _mm256_set1_ps(1.f));
+}
+
+
+AVX2 static inline __m256 square8(__m256 v)
+{
+	return _mm256_mul_ps(v, v);
+}
+
+
+AVX2 static inline __m256i xor8(__m256i a, __m256i b)
+{
+	return _mm256_xor_si256(a, b);
+}
+
+
+AVX2 static inline __m256 simplex2D_8(__m256 x, __m256 y, __m256i seed)
+{
+	const __m256 ones = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	__m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(SIMPLEX_F2));
+	__m256i i = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(x, s)));
+	__m256i j = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(y, s)));
+	__m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(i, j)), _mm256_set1_ps(SIMPLEX_G2));
+	__m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+	__m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+
+	__m256 i1 = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+	__m256 j1 = _mm256_andnot_ps(i1, ones);
+
+	const __m256 g1 = _mm256_set1_ps(SIMPLEX_G2);
+	const __m256 g2 = _mm256_set1_ps(2.f * SIMPLEX_G2);
+	const __m256 one = _mm256_set1_ps(1.f);
+	__m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, cornerOffset8(i1)), g1);
+	__m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, cornerOffset8(j1)), g1);
+	__m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, one), g2);
+	__m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, one), g2);
+
+	const __m256i px = _mm256_set1_epi32(PRIME_X);
+	const __m256i py = _mm256_set1_epi32(PRIME_Y);
+	__m256i xp = _mm256_mullo_epi32(i, px);
+	__m256i yp = _mm256_mullo_epi32(j, py);
+	__m256i n0 = xor8(xor8(xp, yp), seed);
+	__m256i n1 = xor8(xor8(_mm256_add_epi32(xp, cornerStep8(i1, px)),
+		_mm256_add_epi32(yp, cornerStep8(j1, py))), seed);
+	__m256i n2 = xor8(xor8(_mm256_add_epi32(xp, px), _mm256_add_epi32(yp, py)), seed);
+
+	const __m256 r = _mm256_set1_ps(0.5f);
+	__m256 c0 = _mm256_mul_ps(
+		simplexFalloff8(_mm256_sub_ps(_mm256_sub_ps(r, square8(x0)), square8(y0))),
+		simplexGrad2_8(simplexHash8(n0), x0, y0));
+	__m256 c1 = _mm256_mul_ps(
+		simplexFalloff8(_mm256_sub_ps(_mm256_sub_ps(r, square8(x1)), square8(y1))),
+		simplexGrad2_8(simplexHash8(n1), x1, y1));
+	__m256 c2 = _mm256_mul_ps(
+		simplexFalloff8(_mm256_sub_ps(_mm256_sub_ps(r, square8(x2)), square8(y2))),
+		simplexGrad2_8(simplexHash8(n2), x2, y2));
+	return _mm256_mul_ps(_mm256_set1_ps(SIMPLEX_SCALE2),
+		_mm256_add_ps(_mm256_add_ps(c0, c1), c2));
+}
+
+
+AVX2 static inline __m256 simplex3D_8(__m256 x, __m256 y, __m256 z, __m256i seed)
+{
+	const __m256 ones = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	__m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(x, y), z), _mm256_set1_ps(SIMPLEX_F3));
+	__m256i i = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(x, s)));
+	__m256i j = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(y, s)));
+	__m256i k = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(z, s)));
+	__m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(i, j), k)),
+		_mm256_set1_ps(SIMPLEX_G3));
+	__m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+	__m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+	__m256 z0 = _mm256_sub_ps(z, _mm256_sub_ps(_mm256_cvtepi32_ps(k), t));
+
+	__m256 xy = _mm256_cmp_ps(x0, y0, _CMP_GE_OQ);
+	__m256 xz = _mm256_cmp_ps(x0, z0, _CMP_GE_OQ);
+	__m256 yz = _mm256_cmp_ps(y0, z0, _CMP_GE_OQ);
+	__m256 i1 = _mm256_and_ps(xy, xz);
+	__m256 j1 = _mm256_andnot_ps(xy, yz);
+	__m256 k1 = _mm256_andnot_ps(_mm256_or_ps(xz, yz), ones);
+	__m256 i2 = _mm256_or_ps(xy, xz);
+	__m256 j2 = _mm256_or_ps(_mm256_andnot_ps(xy, ones), yz);
+	__m256 k2 = _mm256_andnot_ps(_mm256_and_ps(xz, yz), ones);
+
+	const __m256 g1 = _mm256_set1_ps(SIMPLEX_G3);
+	const __m256 g2 = _mm256_set1_ps(2.f * SIMPLEX_G3);
+	const __m256 g3 = _mm256_set1_ps(3.f * SIMPLEX_G3);
+	const __m256 one = _mm256_set1_ps(1.f);
+	__m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, cornerOffset8(i1)), g1);
+	__m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, cornerOffset8(j1)), g1);
+	__m256 z1 = _mm256_add_ps(_mm256_sub_ps(z0, cornerOffset8(k1)), g1);
+	__m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, cornerOffset8(i2)), g2);
+	__m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, cornerOffset8(j2)), g2);
+	__m256 z2 = _mm256_add_ps(_mm256_sub_ps(z0, cornerOffset8(k2)), g2);
+	__m256 x3 = _mm256_add_ps(_mm256_sub_ps(x0, one), g3);
+	__m256 y3 = _mm256_add_ps(_mm256_sub_ps(y0, one), g3);
+	__m256 z3 = _mm256_add_ps(_mm256_sub_ps(z0, one), g3);
+
+	const __m256i px = _mm256_set1_epi32(PRIME_X);
+	const __m256i py = _mm256_set1_epi32(PRIME_Y);
+	const __m256i pz = _mm256_set1_epi32(PRIME_Z);
+	__m256i xp = _mm256_mullo_epi32(i, px);
+	__m256i yp = _mm256_mullo_epi32(j, py);
+	__m256i zp = _mm256_mullo_epi32(k, pz);
+	__m256i n0 = xor8(xor8(xor8(xp, yp), zp), seed);
+	__m256i n1 = xor8(xor8(xor8(_mm256_add_epi32(xp, cornerStep8(i1, px)),
+		_mm256_add_epi32(yp, cornerStep8(j1, py))),
+		_mm256_add_epi32(zp, cornerStep8(k1, pz))), seed);
+	__m256i n2 = xor8(xor8(xor8(_mm256_add_epi32(xp, cornerStep8(i2, px)),
+		_mm256_add_epi32(yp, cornerStep8(j2, py))),
+		_mm256_add_epi32(zp, cornerStep8(k2, pz))), seed);
+	__m256i n3 = xor8(xor8(xor8(_mm256_add_epi32(xp, px),
+		_mm256_add_epi32(yp, py)), _mm256_add_epi32(zp, pz)), seed);
+
+	const __m256 r = _mm256_set1_ps(0.6f);
+	__m256 c0 = _mm256_mul_ps(simplexFalloff8(_mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(r,
+		square8(x0)), square8(y0)), square8(z0))),
+		simplexGrad3_8(simplexHash8(n0), x0, y0, z0));
+	__m256 c1 = _mm256_mul_ps(simplexFalloff8(_mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(r,
+		square8(x1)), square8(y1)), square8(z1))),
+		simplexGrad3_8(simplexHash8(n1), x1, y1, z1));
+	__m256 c2 = _mm256_mul_ps(simplexFalloff8(_mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(r,
+		square8(x2)), square8(y2)), square8(z2))),
+		simplexGrad3_8(simplexHash8(n2), x2, y2, z2));
+	__m256 c3 = _mm256_mul_ps(simplexFalloff8(_mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(r,
+		square8(x3)), square8(y3)), square8(z3))),
+		simplexGrad3_8(simplexHash8(n3), x3, y3, z3));
+	return _mm256_mul_ps(_mm256_set1_ps(SIMPLEX_SCALE3),
+		_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(c0, c1), c2), c3));
+}
+
+
+// x of points i ... i + 7 of a row
+AVX2 static inline __m256 rowX8(float x, float step_x, u32 i)
+{
+	__m256 k = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+	return _mm256_add_ps(_mm256_set1_ps(x), _mm256_mul_ps(k, _mm256_set1_ps(step_x)));
+}
+
+
+AVX2 static void simplexRow2D_avx2(float *out, u32 count,
+		float x, float step_x, float y, s32 seed)
+{
+	const __m256 vy = _mm256_set1_ps(y);
+	const __m256i vseed = _mm256_set1_epi32(seed);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(out + i, simplex2D_8(rowX8(x, step_x, i), vy, vseed));
+	_mm256_zeroupper();
+	simplexRow2D_from(out, i, count, x, step_x, y, seed);
+}
+
+
+AVX2 static void simplexRow3D_avx2(float *out, u32 count,
+		float x, float step_x, float y, float z, s32 seed)
+{
+	const __m256 vy = _mm256_set1_ps(y);
+	const __m256 vz = _mm256_set1_ps(z);
+	const __m256i vseed = _mm256_set1_epi32(seed);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(out + i, simplex3D_8(rowX8(x, step_x, i), vy, vz, vseed));
+	_mm256_zeroupper();
+	simplexRow3D_from(out, i, count, x, step_x, y, z, seed);
+}
+
+
+#undef AVX2
+
+static bool have_avx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static bool have_sse41()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.1");
+}
+
+static const bool use_avx2 = have_avx2();
+static const bool use_sse41 = have_sse41();
+
+const GradientRow2dFxn gradientRow2D = use_avx2 ? gradientRow2D_avx2 : gradientRow2D_sse2;
+const GradientRow3dFxn gradientRow3D = use_avx2 ? gradientRow3D_avx2 : gradientRow3D_sse2;
+const LatticeRowFxn latticeRow = use_avx2 ? latticeRow_avx2 :
+		use_sse41 ? latticeRow_sse41 : latticeRow_scalar;
+const SimplexRow2dFxn simplexRow2D = use_avx2 ? simplexRow2D_avx2 :
+		use_sse41 ? simplexRow2D_sse41 : simplexRow2D_scalar;
+const SimplexRow3dFxn simplexRow3D = use_avx2 ? simplexRow3D_avx2 :
+		use_sse41 ? simplexRow3D_sse41 : simplexRow3D_scalar;
+const char *const noise_kernel_isa = use_avx2 ? "AVX2" :
+		use_sse41 ? "SSE4.1 (gradient rows SSE2)" : "SSE2 (lattice and simplex rows scalar)";
+
+#else
+
+const GradientRow2dFxn gradientRow2D = gradientRow2D_scalar;
+const GradientRow3dFxn gradientRow3D = gradientRow3D_scalar;
+const LatticeRowFxn latticeRow = latticeRow_scalar;
+const SimplexRow2dFxn simplexRow2D = simplexRow2D_scalar;
+const SimplexRow3dFxn simplexRow3D = simplexRow3D_scalar;
+const char *const noise_kernel_isa = "scalar";
+
+#endif
@@ -0,0 +1,75 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "types.hxx"
+
+/*
+ * Row kernels of Noise::gradientMap2D/3D.
+ *
+ * The lattice advance along x is the same for every row, so the callers
+ * precompute, per column, the lattice cell index `noisex` and the (eased, if
+ * requested) fraction `tx`. A kernel then interpolates a whole row from the
+ * lattice rows it spans. All variants do exactly the same float operations
+ * in the same order as the scalar code, and never fuse a multiply with an
+ * add, so the result is bit-identical whichever one is picked at runtime.
+ */
+
+/// out[i] = lerp(lerp(r0[n], r0[n+1], tx[i]), lerp(r1[n], r1[n+1], tx[i]), ty)
+/// where n = noisex[i].
+typedef void (*GradientRow2dFxn)(float *out, u32 count,
+		const float *r0, const float *r1,
+		const u32 *noisex, const float *tx, float ty);
+
+/// Same as GradientRow2dFxn, for rows r00, r10 at the lower z and r01, r11
+/// at the upper z, then interpolated by tz.
+typedef void (*GradientRow3dFxn)(float *out, u32 count,
+		const float *r00, const float *r10,
+		const float *r01, const float *r11,
+		const u32 *noisex, const float *tx, float ty, float tz);
+
+/*
+ * Lattice hash of noise2d/noise3d over a row of points: the hash input of
+ * point i is n0 + i * step, then it is mixed exactly like in those functions.
+ * Integer math is exact, and the conversion to float is the same everywhere,
+ * so every variant gives the very same values.
+ */
+typedef void (*LatticeRowFxn)(float *out, u32 count, u32 n0, u32 step);
+
+/*
+ * Simplex noise over a row of points: point i is at x + i * step_x. Unlike
+ * the gradient kernels, these need no lattice, each point only hashes the
+ * 3 (2D) or 4 (3D) corners of its simplex. Bit-identical across variants too.
+ */
+typedef void (*SimplexRow2dFxn)(float *out, u32 count,
+		float x, float step_x, float y, s32 seed);
+typedef void (*SimplexRow3dFxn)(float *out, u32 count,
+		float x, float step_x, float y, float z, s32 seed);
+
+/// Best kernels this CPU supports. Chosen when the library is loaded.
+extern const GradientRow2dFxn gradientRow2D;
+extern const GradientRow3dFxn gradientRow3D;
+extern const LatticeRowFxn latticeRow;
+extern const SimplexRow2dFxn simplexRow2D;
+extern const SimplexRow3dFxn simplexRow3D;
+
+/// Instruction sets of the chosen kernels, for logging. The gradient rows
+/// have no SSE4.1 variant, the lattice and simplex rows no SSE2 one.
+extern const char *const noise_kernel_isa;
@@ -0,0 +1,310 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "profiler.hxx"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+
+static Profiler main_profiler;
+Profiler *g_profiler = &main_profiler;
+
+
+int ProfilerHistogram::bucket(uint64_t ns)
+{
+	constexpr uint64_t sub = 1 << SUB_BITS;
+	if (ns < sub)
+		return ns;
+	int e = 63 - __builtin_clzll(ns);
+	return ((e - SUB_BITS + 1) << SUB_BITS) | ((ns >> (e - SUB_BITS)) & (sub - 1));
+}
+
+
+uint64_t ProfilerHistogram::bucketStart(int bucket)
+{
+	constexpr int sub = 1 << SUB_BITS;
+	if (bucket < sub)
+		return bucket;
+	int e = (bucket >> SUB_BITS) + SUB_BITS - 1;
+	return uint64_t(sub | (bucket & (sub - 1))) << (e - SUB_BITS);
+}
+
+
+void ProfilerHistogram::add(uint64_t ns)
+{
+	count++;
+	total += ns;
+	min = std::min(min, ns);
+	max = std::max(max, ns);
+	buckets[bucket(ns)]++;
+}
+
+
+void ProfilerHistogram::merge(const ProfilerHistogram &other)
+{
+	count += other.count;
+	total += other.total;
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+	for (size_t k = 0; k < buckets.size(); k++)
+		buckets[k] += other.buckets[k];
+}
+
+
+uint64_t ProfilerHistogram::percentile(double p) const
+{
+	if (!count)
+		return 0;
+	uint64_t rank = std::max<uint64_t>(1, std::ceil(p * count));
+	uint64_t seen = 0;
+	// the last bucket that can be nonempty is the one of UINT64_MAX
+	const int last = bucket(UINT64_MAX);
+	for (int k = 0; k < last; k++) {
+		seen += buckets[k];
+		if (seen >= rank)
+			return std::min(bucketStart(k + 1) - 1, max);
+	}
+	return max;
+}
+
+
+Profiler::Profiler() :
+	start_time(now())
+{
+}
+
+
+Profiler::~Profiler() = default;
+
+
+Profiler::ThreadRing *Profiler::ring()
+{
+	// Profilers are few and long-lived, so remembering the last one used
+	// is enough to not take the lock on every zone
+	thread_local Profiler *cached_profiler = nullptr;
+	thread_local ThreadRing *cached_ring = nullptr;
+	if (cached_profiler == this)
+		return cached_ring;
+
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	std::thread::id self = std::this_thread::get_id();
+	ThreadRing *found = nullptr;
+	for (auto &r : rings) {
+		if (r->owner == self)
+			found = r.get();
+	}
+	if (!found) {
+		// an exited thread's id may be reused, and its ring with it
+		rings.push_back(std::make_unique<ThreadRing>());
+		found = rings.back().get();
+		found->id = rings.size() - 1;
+		found->owner = self;
+		found->name = "Thread " + std::to_string(found->id);
+	}
+	cached_profiler = this;
+	cached_ring = found;
+	return found;
+}
+
+
+void Profiler::record(const char *zone, uint64_t begin, uint64_t end)
+{
+	ThreadRing *r = ring();
+	uint64_t head = r->head.load(std::memory_order_relaxed);
+	if (head - r->tail.load(std::memory_order_acquire) >= RING_SIZE) {
+		r->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	r->events[head % RING_SIZE] = {zone, begin, end};
+	r->head.store(head + 1, std::memory_order_release);
+}
+
+
+void Profiler::setThreadName(const std::string &name)
+{
+	ThreadRing *r = ring();
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	r->name = name;
+}
+
+
+void Profiler::setTraceCapacity(size_t max_events)
+{
+	std::lock_guard<std::mutex> lock(collect_mutex);
+	max_trace_events = max_events;
+	if (trace.size() > max_events)
+		trace.resize(max_events);
+}
+
+
+unsigned Profiler::zoneId(const char *zone)
+{
+	auto it = zone_ids.find(zone);
+	if (it != zone_ids.end())
+		return it->second;
+	// the same name may be at different addresses in different libraries
+	unsigned id = std::find(zones.begin(), zones.end(), zone) - zones.begin();
+	if (id == zones.size()) {
+		zones.emplace_back(zone);
+		histograms.emplace_back();
+	}
+	zone_ids.emplace(zone, id);
+	return id;
+}
+
+
+void Profiler::collect()
+{
+	std::lock_guard<std::mutex> lock(collect_mutex);
+	std::vector<ThreadRing *> current;
+	{
+		std::lock_guard<std::mutex> rings_lock(rings_mutex);
+		for (auto &r : rings)
+			current.push_back(r.get());
+	}
+
+	for (ThreadRing *r : current) {
+		uint64_t tail = r->tail.load(std::memory_order_relaxed);
+		uint64_t head = r->head.load(std::memory_order_acquire);
+		for (; tail != head; tail++) {
+			const Event &e = r->events[tail % RING_SIZE];
+			unsigned zone = zoneId(e.zone);
+			std::vector<ProfilerHistogram> &per_thread = histograms[zone];
+			if (per_thread.size() <= r->id)
+				per_thread.resize(r->id + 1);
+			per_thread[r->id].add(e.end - e.begin);
+			if (trace.size() < max_trace_events)
+				trace.push_back({zone, r->id, e.begin, e.end});
+		}
+		r->tail.store(tail, std::memory_order_release);
+	}
+}
+
+
+void Profiler::clear()
+{
+	std::lock_guard<std::mutex> lock(collect_mutex);
+	zone_ids.clear();
+	zones.clear();
+	histograms.clear();
+	trace.clear();
+}
+
+
+std::vector<Profiler::ZoneStats> Profiler::stats(bool per_thread) const
+{
+	std::lock_guard<std::mutex> lock(collect_mutex);
+	std::lock_guard<std::mutex> rings_lock(rings_mutex);
+	std::vector<ZoneStats> result;
+	for (size_t zone = 0; zone < zones.size(); zone++) {
+		ZoneStats totals{zones[zone], "", {}};
+		for (const ProfilerHistogram &h : histograms[zone])
+			totals.histogram.merge(h);
+		result.push_back(std::move(totals));
+		if (!per_thread)
+			continue;
+		for (size_t thread = 0; thread < histograms[zone].size(); thread++) {
+			const ProfilerHistogram &h = histograms[zone][thread];
+			if (h.count)
+				result.push_back({zones[zone], rings[thread]->name, h});
+		}
+	}
+	return result;
+}
+
+
+uint64_t Profiler::dropped() const
+{
+	std::lock_guard<std::mutex> lock(rings_mutex);
+	uint64_t sum = 0;
+	for (auto &r : rings)
+		sum += r->dropped.load(std::memory_order_relaxed);
+	return sum;
+}
+
+
+// Zone and thread names are plain text, but may have quotes in them
+static std::string json_string(const std::string &s)
+{
+	std::string out = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\')
+			out += '\\';
+		if (static_cast<unsigned char>(c) >= 0x20)
+			out += c;
+	}
+	return out + "\"";
+}
+
+
+static void write_histogram(std::FILE *file, const ProfilerHistogram &h)
+{
+	std::fprintf(file, "\"count\": %llu, \"min_ms\": %.4f, \"mean_ms\": %.4f, "
+		"\"p50_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f",
+		static_cast<unsigned long long>(h.count), 1e-6 * (h.count ? h.min : 0),
+		1e-6 * h.mean(), 1e-6 * h.percentile(0.5), 1e-6 * h.percentile(0.99),
+		1e-6 * h.max);
+}
+
+
+void Profiler::writeJson(std::FILE *file) const
+{
+	std::vector<ZoneStats> all = stats();
+	std::fprintf(file, "{\"dropped\": %llu, \"zones\": [\n",
+		static_cast<unsigned long long>(dropped()));
+	for (size_t k = 0; k < all.size(); k++) {
+		const ZoneStats &s = all[k];
+		bool last_thread = k + 1 == all.size() || all[k + 1].thread.empty();
+		if (s.thread.empty()) {
+			std::fprintf(file, "\t{\"zone\": %s, ", json_string(s.zone).c_str());
+			write_histogram(file, s.histogram);
+			std::fprintf(file, ", \"threads\": [\n");
+			continue;
+		}
+		std::fprintf(file, "\t\t{\"thread\": %s, ", json_string(s.thread).c_str());
+		write_histogram(file, s.histogram);
+		std::fprintf(file, "}%s\n", last_thread ? "" : ",");
+		if (last_thread)
+			std::fprintf(file, "\t]}%s\n", k + 1 == all.size() ? "" : ",");
+	}
+	std::fprintf(file, "]}\n");
+}
+
+
+void Profiler::writeTrace(std::FILE *file) const
+{
+	std::lock_guard<std::mutex> lock(collect_mutex);
+	std::lock_guard<std::mutex> rings_lock(rings_mutex);
+	std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	const char *separator = "";
+	for (auto &r : rings) {
+		std::fprintf(file, "%s\t{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+			"\"args\": {\"name\": %s}}", separator, r->id, json_string(r->name).c_str());
+		separator = ",\n";
+	}
+	for (const TraceEvent &e : trace) {
+		std::fprintf(file, "%s\t{\"name\": %s, \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+			"\"ts\": %.3f, \"dur\": %.3f}", separator, json_string(zones[e.zone]).c_str(),
+			e.thread, 1e-3 * (int64_t(e.begin) - int64_t(start_time)),
+			1e-3 * (e.end - e.begin));
+		separator = ",\n";
+	}
+	std::fprintf(file, "\n]}\n");
+}
@@ -0,0 +1,182 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Durations of named zones of code, per thread.
+ *
+ * A zone is a ScopeProfiler on the stack; its name must be a string literal,
+ * or at least outlive the profiler. Each thread records its zones into a ring
+ * of its own, which only that thread writes and only collect() reads, so
+ * recording takes no lock: two clock reads and a store. If the ring is full
+ * because nothing collects, the zone is dropped and counted.
+ *
+ * collect() moves the recorded zones into a histogram per zone and thread,
+ * to read the count, minimum, mean and percentiles from. Any thread may
+ * collect, one at a time; the others go on recording meanwhile.
+ */
+
+// Durations in nanoseconds, in buckets of 1/8 of a power of two, so that a
+// percentile is off by at most 12.5%
+class ProfilerHistogram {
+public:
+	uint64_t count = 0;
+	uint64_t total = 0;
+	uint64_t min = UINT64_MAX;
+	uint64_t max = 0;
+
+	void add(uint64_t ns);
+	void merge(const ProfilerHistogram &other);
+
+	double mean() const { return count ? double(total) / count : 0.0; }
+	// Upper bound of the bucket the p-th quantile (0 to 1) falls into, at most max
+	uint64_t percentile(double p) const;
+
+private:
+	static constexpr int SUB_BITS = 3;
+	std::array<uint32_t, 64 << SUB_BITS> buckets{};
+
+	static int bucket(uint64_t ns);
+	static uint64_t bucketStart(int bucket);
+};
+
+class Profiler {
+public:
+	struct ZoneStats {
+		std::string zone;
+		std::string thread; // empty for the totals of all threads
+		ProfilerHistogram histogram;
+	};
+
+	Profiler();
+	~Profiler();
+	Profiler(const Profiler &) = delete;
+	Profiler &operator=(const Profiler &) = delete;
+
+	static uint64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Records a zone of the calling thread, times as given by now()
+	void record(const char *zone, uint64_t begin, uint64_t end);
+
+	// Names the calling thread in the stats and traces
+	void setThreadName(const std::string &name);
+
+	// Keeps up to `max_events` collected zones for writeTrace(), 0 for none
+	void setTraceCapacity(size_t max_events);
+
+	// Moves the zones recorded so far into the stats
+	void collect();
+	// Forgets the stats and the kept zones
+	void clear();
+
+	// Per zone, the totals followed by each thread, in the order the zones
+	// were first collected
+	std::vector<ZoneStats> stats(bool per_thread = true) const;
+	// Zones dropped because a ring was full
+	uint64_t dropped() const;
+
+	// Stats as JSON, durations in milliseconds
+	void writeJson(std::FILE *file) const;
+	// Kept zones in the Chrome trace event format, for chrome://tracing
+	// or Perfetto
+	void writeTrace(std::FILE *file) const;
+
+private:
+	struct Event {
+		const char *zone;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	static constexpr size_t RING_SIZE = 1 << 14;
+
+	struct ThreadRing {
+		unsigned id;
+		std::thread::id owner;
+		std::string name;
+		std::atomic<uint64_t> head{0}; // written by the owner
+		std::atomic<uint64_t> tail{0}; // written by collect()
+		std::atomic<uint64_t> dropped{0};
+		std::array<Event, RING_SIZE> events;
+	};
+
+	struct TraceEvent {
+		unsigned zone;
+		unsigned thread;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	// Guards rings and the thread names
+	mutable std::mutex rings_mutex;
+	std::vector<std::unique_ptr<ThreadRing>> rings;
+
+	// Owned by the collecting thread, under collect_mutex
+	mutable std::mutex collect_mutex;
+	std::unordered_map<const char *, unsigned> zone_ids;
+	std::vector<std::string> zones;
+	// [zone][thread]
+	std::vector<std::vector<ProfilerHistogram>> histograms;
+	size_t max_trace_events = 0;
+	std::vector<TraceEvent> trace;
+	uint64_t start_time;
+
+	ThreadRing *ring();
+	unsigned zoneId(const char *zone);
+};
+
+extern Profiler *g_profiler;
+
+// Records the time from its construction to its destruction as a zone
+class ScopeProfiler {
+public:
+	ScopeProfiler(Profiler *profiler, const char *zone) :
+		m_profiler(profiler), m_zone(zone), m_begin(Profiler::now())
+	{}
+
+	~ScopeProfiler()
+	{
+		m_profiler->record(m_zone, m_begin, Profiler::now());
+	}
+
+	ScopeProfiler(const ScopeProfiler &) = delete;
+	ScopeProfiler &operator=(const ScopeProfiler &) = delete;
+
+private:
+	Profiler *m_profiler;
+	const char *m_zone;
+	uint64_t m_begin;
+};
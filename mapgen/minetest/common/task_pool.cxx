@@ -0,0 +1,100 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "task_pool.hxx"
+#include "profiler.hxx"
+
+
+TaskPool::TaskPool(unsigned threads)
+{
+	for (unsigned k = 1; k < threads; k++)
+		workers.emplace_back(&TaskPool::work, this, k);
+}
+
+
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+
+void TaskPool::run(unsigned count, void (*fn)(void *, unsigned), void *fn_arg)
+{
+	if (count == 0)
+		return;
+	std::unique_lock<std::mutex> lock(mutex);
+	call = fn;
+	arg = fn_arg;
+	job_id++;
+	parts = count;
+	next = 0;
+	finished = 0;
+	error = nullptr;
+	wake.notify_all();
+	runParts(lock);
+	done.wait(lock, [this] { return finished == parts; });
+	call = nullptr;
+	arg = nullptr;
+	if (error)
+		std::rethrow_exception(error);
+}
+
+
+void TaskPool::work(unsigned index)
+{
+	g_profiler->setThreadName("TaskPool worker " + std::to_string(index));
+	std::unique_lock<std::mutex> lock(mutex);
+	unsigned seen = job_id;
+	for (;;) {
+		wake.wait(lock, [&] { return stopping || job_id != seen; });
+		if (stopping)
+			return;
+		seen = job_id;
+		runParts(lock);
+	}
+}
+
+
+void TaskPool::runParts(std::unique_lock<std::mutex> &lock)
+{
+	while (next < parts) {
+		unsigned k = next++;
+		void (*fn)(void *, unsigned) = call;
+		void *fn_arg = arg;
+		lock.unlock();
+		std::exception_ptr e;
+		try {
+			ScopeProfiler sp(g_profiler, "TaskPool: part");
+			fn(fn_arg, k);
+		} catch (...) {
+			e = std::current_exception();
+		}
+		lock.lock();
+		if (e && !error)
+			error = e;
+		if (++finished == parts)
+			done.notify_all();
+	}
+}
@@ -0,0 +1,74 @@
+/*
+Minetest
+Copyright (C) 2019 numzero, Lobachevskiy Vitaliy <numzer0@yandex.ru>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A few threads to split the work on a single chunk across, for when that
+ * chunk is needed as soon as possible.
+ *
+ * run() hands out the parts of a job to the workers and the calling thread
+ * alike and returns once all of them are done. Which thread does which part
+ * is unspecified, so parts must not depend on each other; the result then
+ * does not depend on the schedule either.
+ */
+class TaskPool {
+public:
+	// A pool of `threads` threads, the calling one included
+	explicit TaskPool(unsigned threads = std::thread::hardware_concurrency());
+	~TaskPool();
+	TaskPool(const TaskPool &) = delete;
+	TaskPool &operator=(const TaskPool &) = delete;
+
+	unsigned threads() const { return workers.size() + 1; }
+
+	// Calls fn(k) for each k in [0, parts). Not reentrant.
+	// Rethrows the first exception thrown by fn, if any.
+	template <typename F>
+	void run(unsigned parts, F &&fn)
+	{
+		run(parts, [] (void *f, unsigned k) { (*static_cast<F *>(f))(k); },
+			const_cast<void *>(static_cast<const void *>(&fn)));
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	// the job, not owned so that starting one does not allocate
+	void (*call)(void *, unsigned) = nullptr;
+	void *arg = nullptr;
+	unsigned job_id = 0;
+	unsigned parts = 0;
+	unsigned next = 0; // first part not taken yet
+	unsigned finished = 0;
+	std::exception_ptr error;
+	bool stopping = false;
+
+	void run(unsigned parts, void (*call)(void *, unsigned), void *arg);
+	void work(unsigned index);
+	void runParts(std::unique_lock<std::mutex> &lock);
+};
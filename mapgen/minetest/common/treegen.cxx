@@ -0,0 +1,272 @@
+/*
+Minetest
+Copyright (C) 2010-2018 celeron55, Perttu Ahola <celeron55@gmail.com>,
+Copyright (C) 2012-2018 RealBadAngel, Maciej Kasatkin
+Copyright (C) 2015-2018 paramat
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "treegen.hxx"
+#include "noise.hxx"
+
+namespace treegen {
+
+TreeTemplate::TreeTemplate(v3s16 min, v3s16 max) :
+	min(min), size(max - min + 1), nodes(size.x * size.y * size.z)
+{
+}
+
+
+TreeNode &TreeTemplate::at(v3s16 p)
+{
+	p -= min;
+	return nodes[p.y + size.y * (p.x + size.x * p.z)];
+}
+
+
+void TreeTemplate::finish()
+{
+	// Shrink the box to the nodes that are set
+	v3s16 lo = min + size, hi = min - 1;
+	for (s16 z = 0; z < size.z; z++)
+	for (s16 y = 0; y < size.y; y++)
+	for (s16 x = 0; x < size.x; x++) {
+		v3s16 p = min + v3s16(x, y, z);
+		if (at(p).stamp != Stamp::Skip) {
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+	}
+	TreeTemplate shrunk(lo, hi);
+	for (s16 z = lo.z; z <= hi.z; z++)
+	for (s16 y = lo.y; y <= hi.y; y++)
+	for (s16 x = lo.x; x <= hi.x; x++)
+		shrunk.at(v3s16(x, y, z)) = at(v3s16(x, y, z));
+	*this = std::move(shrunk);
+
+	columns.resize(size.x * size.z);
+	for (int column = 0; column < size.x * size.z; column++) {
+		const TreeNode *n = &nodes[size.y * column];
+		s16 begin = 0, end = size.y;
+		while (begin < end && n[begin].stamp == Stamp::Skip)
+			begin++;
+		while (end > begin && n[end - 1].stamp == Stamp::Skip)
+			end--;
+		columns[column] = {begin, end};
+	}
+}
+
+
+namespace {
+
+// The leaves_d buffers of Minetest: for each node of a box around the top of
+// the trunk, 0 for nothing or which kind of leaves goes there
+struct LeavesArea {
+	v3s16 min;
+	v3s16 max;
+	std::vector<u8> data;
+
+	LeavesArea(v3s16 min, v3s16 max) :
+		min(min), max(max), data((max.x - min.x + 1) * (max.y - min.y + 1) * (max.z - min.z + 1))
+	{
+	}
+
+	u8 &operator[](v3s16 p)
+	{
+		p -= min;
+		return data[p.x + (max.x - min.x + 1) * (p.y + (max.y - min.y + 1) * p.z)];
+	}
+
+	// Leaves near the end of the trunk, and `count` random clumps
+	void addClumps(PseudoRandom &pr, u32 count)
+	{
+		s16 d = 1;
+		for (s16 z = -d; z <= d; z++)
+		for (s16 y = -d; y <= d; y++)
+		for (s16 x = -d; x <= d; x++)
+			(*this)[v3s16(x, y, z)] = 1;
+
+		for (u32 iii = 0; iii < count; iii++) {
+			v3s16 p(
+				pr.range(min.x, max.x - d),
+				pr.range(min.y, max.y - d),
+				pr.range(min.z, max.z - d)
+			);
+			for (s16 z = 0; z <= d; z++)
+			for (s16 y = 0; y <= d; y++)
+			for (s16 x = 0; x <= d; x++)
+				(*this)[p + v3s16(x, y, z)] = 1;
+		}
+	}
+
+	// Puts the leaves into t around p1, where the trunk is not, in the
+	// order Minetest does; `leaf` gives the content for a value of d
+	template <typename F>
+	void blit(TreeTemplate &t, v3s16 p1, F &&leaf)
+	{
+		for (s16 z = min.z; z <= max.z; z++)
+		for (s16 y = min.y; y <= max.y; y++)
+		for (s16 x = min.x; x <= max.x; x++) {
+			v3s16 p(x, y, z);
+			TreeNode &n = t.at(p1 + p);
+			if (n.stamp != Stamp::Skip || (*this)[p] == 0)
+				continue;
+			n = {leaf((*this)[p]), Stamp::OverAir};
+		}
+	}
+};
+
+}
+
+
+TreeTemplate make_tree(bool is_apple_tree, content_t tree, content_t leaves,
+	content_t apple, s32 seed)
+{
+	PseudoRandom pr(seed);
+	s16 trunk_h = pr.range(4, 5);
+
+	// p1 is the last piece of the trunk
+	v3s16 p1(0, trunk_h - 1, 0);
+	LeavesArea leaves_a(v3s16(-2, -1, -2), v3s16(2, 2, 2));
+	TreeTemplate t(v3s16(-2, 0, -2), p1 + leaves_a.max);
+	for (s16 y = 0; y < trunk_h; y++)
+		t.at(v3s16(0, y, 0)) = {tree, Stamp::Replace};
+
+	leaves_a.addClumps(pr, 7);
+	leaves_a.blit(t, p1, [&] (u8) {
+		bool is_apple = pr.range(0, 99) < 10;
+		return is_apple_tree && is_apple ? apple : leaves;
+	});
+	t.finish();
+	return t;
+}
+
+
+TreeTemplate make_jungletree(content_t tree, content_t leaves, s32 seed)
+{
+	PseudoRandom pr(seed);
+	LeavesArea leaves_a(v3s16(-3, -2, -3), v3s16(3, 2, 3));
+	// As tall as the trunk can be; finish shrinks it to the actual one
+	TreeTemplate t(v3s16(-3, 0, -3), v3s16(0, 11, 0) + leaves_a.max);
+
+	// Roots, over air
+	for (s16 x = -1; x <= 1; x++)
+	for (s16 z = -1; z <= 1; z++) {
+		if (pr.range(0, 2) == 0)
+			continue;
+		t.at(v3s16(x, 0, z)) = {tree, Stamp::OverAir};
+	}
+
+	s16 trunk_h = pr.range(8, 12);
+	for (s16 y = 0; y < trunk_h; y++)
+		t.at(v3s16(0, y, 0)) = {tree, Stamp::Replace};
+
+	// p1 is the last piece of the trunk
+	v3s16 p1(0, trunk_h - 1, 0);
+	leaves_a.addClumps(pr, 30);
+	leaves_a.blit(t, p1, [&] (u8) { return leaves; });
+	t.finish();
+	return t;
+}
+
+
+TreeTemplate make_pine_tree(content_t tree, content_t needles, content_t snow,
+	s32 seed)
+{
+	PseudoRandom pr(seed);
+	u16 trunk_h = pr.range(9, 13);
+
+	// The trunk starts in the ground; p1 is its top node
+	v3s16 p1(0, trunk_h - 2, 0);
+	LeavesArea leaves_a(v3s16(-3, -6, -3), v3s16(3, 3, 3));
+	TreeTemplate t(v3s16(-3, -1, -3), p1 + leaves_a.max);
+	for (s16 y = -1; y <= p1.y; y++)
+		t.at(v3s16(0, y, 0)) = {tree, Stamp::Replace};
+
+	// Upper branches
+	s16 dev = 3;
+	for (s16 yy = -1; yy <= 1; yy++) {
+		for (s16 zz = -dev; zz <= dev; zz++)
+		for (s16 xx = -dev; xx <= dev; xx++) {
+			if (pr.range(0, 20) <= 19 - dev) {
+				leaves_a[v3s16(xx, yy, zz)] = 1;
+				leaves_a[v3s16(xx, yy + 1, zz)] = 2;
+			}
+		}
+		dev--;
+	}
+
+	// Centre top nodes
+	leaves_a[v3s16(0, 1, 0)] = 1;
+	leaves_a[v3s16(0, 2, 0)] = 1;
+	leaves_a[v3s16(0, 3, 0)] = 2;
+
+	// Lower branches
+	s16 my = -6;
+	for (u32 iii = 0; iii < 20; iii++) {
+		s16 xi = pr.range(-3, 2);
+		s16 yy = pr.range(-6, -5);
+		s16 zi = pr.range(-3, 2);
+		if (yy > my)
+			my = yy;
+		for (s16 zz = zi; zz <= zi + 1; zz++)
+		for (s16 xx = xi; xx <= xi + 1; xx++) {
+			leaves_a[v3s16(xx, yy, zz)] = 1;
+			if (leaves_a[v3s16(xx, yy + 1, zz)] == 0)
+				leaves_a[v3s16(xx, yy + 1, zz)] = 2;
+		}
+	}
+
+	dev = 2;
+	for (s16 yy = my + 1; yy <= my + 2; yy++) {
+		for (s16 zz = -dev; zz <= dev; zz++)
+		for (s16 xx = -dev; xx <= dev; xx++) {
+			if (pr.range(0, 20) <= 19 - dev) {
+				leaves_a[v3s16(xx, yy, zz)] = 1;
+				leaves_a[v3s16(xx, yy + 1, zz)] = 2;
+			}
+		}
+		dev--;
+	}
+
+	leaves_a.blit(t, p1, [&] (u8 d) { return d == 1 ? needles : snow; });
+	t.finish();
+	return t;
+}
+
+
+void place_tree(MMVManip &vm, const TreeTemplate &tree, v3s16 p)
+{
+	v3s16 base = p + tree.min;
+	for (s16 z = 0; z < tree.size.z; z++)
+	for (s16 x = 0; x < tree.size.x; x++) {
+		int column = x + tree.size.x * z;
+		TreeTemplate::Column c = tree.columns[column];
+		const TreeNode *src = &tree.nodes[tree.size.y * column + c.begin];
+		vm.write_column(base + v3s16(x, c.begin, z), c.end - c.begin,
+			[&] (MapNode *dest, int k, int size) {
+				const TreeNode *n = src + k;
+				for (int i = 0; i < size; i++) {
+					content_t old = dest[i].content;
+					if (n[i].stamp == Stamp::Replace || (n[i].stamp == Stamp::OverAir &&
+							(old == CONTENT_AIR || old == CONTENT_IGNORE)))
+						dest[i] = MapNode{n[i].content};
+				}
+			});
+	}
+}
+
+}; // namespace treegen
@@ -0,0 +1,82 @@
+/*
+Minetest
+Copyright (C) 2010-2018 celeron55, Perttu Ahola <celeron55@gmail.com>,
+Copyright (C) 2012-2018 RealBadAngel, Maciej Kasatkin
+Copyright (C) 2015-2018 paramat
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+#include "map.hxx"
+#include "types.hxx"
+
+/*
+ * The trees of mapgen v6, as templates: the shape a tree gets from its seed
+ * is computed once, and placing a tree is then copying it over the map,
+ * a column at a time.
+ */
+
+namespace treegen {
+
+// How a template node goes over the map
+enum class Stamp : u8 {
+	Skip,    // not part of the tree
+	Replace, // over anything, as trunks do
+	OverAir, // over air and ungenerated nodes only, as leaves do
+};
+
+struct TreeNode {
+	content_t content = CONTENT_AIR;
+	Stamp stamp = Stamp::Skip;
+};
+
+struct TreeTemplate {
+	// Corner and size of the box of the tree, relative to its position
+	v3s16 min;
+	v3s16 size;
+	// size.x * size.z columns of size.y nodes, bottom up: the node at
+	// (x, y, z) from min is nodes[y + size.y * (x + size.x * z)]
+	std::vector<TreeNode> nodes;
+	// Of each column, the nodes from `begin` to `end` (exclusive) hold all
+	// of those that are not Skip; empty columns have begin == end
+	struct Column {
+		s16 begin;
+		s16 end;
+	};
+	std::vector<Column> columns;
+
+	TreeTemplate(v3s16 min, v3s16 max);
+
+	TreeNode &at(v3s16 p);
+	// Sets up `columns`, once the nodes are all set
+	void finish();
+};
+
+// The trees make_tree, make_jungletree and make_pine_tree of Minetest make
+// from `seed`, positioned at the node above the ground. These test the map
+// before placing a few nodes; the templates place them as if it was air.
+TreeTemplate make_tree(bool is_apple_tree, content_t tree, content_t leaves,
+	content_t apple, s32 seed);
+TreeTemplate make_jungletree(content_t tree, content_t leaves, s32 seed);
+TreeTemplate make_pine_tree(content_t tree, content_t needles, content_t snow,
+	s32 seed);
+
+// Writes `tree` at p, which has to have all of the box of the tree in vm
+void place_tree(MMVManip &vm, const TreeTemplate &tree, v3s16 p);
+
+}; // namespace treegen
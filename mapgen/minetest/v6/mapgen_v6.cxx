@@ -22,7 +22,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapgen_v6.hxx"
 
+#include <algorithm>
 #include <cmath>
+#include <mutex>
+#include <stdexcept>
 #include "mapgen.hxx"
 // #include "voxel.h"
 #include "noise.hxx"
@@ -33,7 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // #include "content_sao.h"
 // #include "nodedef.h"
 // #include "voxelalgorithms.h"
-//#include "profiler.h" // For TimeTaker
+#include "profiler.hxx"
 // #include "settings.h" // For g_settings
 // #include "emerge.h"
 // #include "dungeongen.h"
@@ -77,6 +80,7 @@ MapgenV6::MapgenV6(MapgenV6Params *params, MapV6Params map_params)
 	freq_beach   = params->freq_beach;
 	dungeon_ymin = params->dungeon_ymin;
 	dungeon_ymax = params->dungeon_ymax;
+	cave_width   = params->cave_width;
 
 	np_cave        = &params->np_cave;
 	np_humidity    = &params->np_humidity;
@@ -96,6 +100,21 @@ MapgenV6::MapgenV6(MapgenV6Params *params, MapV6Params map_params)
 			csize.x + 2 * CHUNK_PADDING, csize.y + 2 * CHUNK_PADDING);
 	noise_humidity       = new Noise(&params->np_humidity,       seed,
 			csize.x + 2 * CHUNK_PADDING, csize.y + 2 * CHUNK_PADDING);
+	noise_terrain        = new FusedNoise2D({noise_terrain_base,
+			noise_terrain_higher, noise_steepness, noise_height_select, noise_mud});
+
+	terrain_level = new float[csize.x * csize.z];
+
+	// Sized for a whole chunk; generateCaves only uses the rows it needs
+	noise_cave1 = new Noise(&params->np_cave1, seed, csize.x, csize.y, csize.z);
+	noise_cave2 = new Noise(&params->np_cave2, seed, csize.x, csize.y, csize.z);
+
+	// The tree amount is only needed at the centers of the divisions, a
+	// division apart; scaling the spread down by that much makes these
+	// consecutive points of the map
+	NoiseParams np_trees = params->np_trees;
+	np_trees.spread /= (float)(csize.x / MGV6_TREE_DIVISIONS);
+	noise_trees = new Noise(&np_trees, seed, MGV6_TREE_DIVISIONS, MGV6_TREE_DIVISIONS);
 
 	c = map_params;
 
@@ -119,11 +138,36 @@ MapgenV6::MapgenV6(MapgenV6Params *params, MapV6Params map_params)
 		c.stair_cobble = c.cobble;
 	if (c.stair_desert_stone == CONTENT_IGNORE)
 		c.stair_desert_stone = c.desert_stone;
+	if (c.apple == CONTENT_IGNORE)
+		c.apple = c.leaves;
+	if (c.jungletree == CONTENT_IGNORE)
+		c.jungletree = c.tree;
+	if (c.jungleleaves == CONTENT_IGNORE)
+		c.jungleleaves = c.leaves;
+	// if we don't have junglegrass, don't place cignore... that's bad
+	if (c.junglegrass == CONTENT_IGNORE)
+		c.junglegrass = CONTENT_AIR;
+	if (c.pine_tree == CONTENT_IGNORE)
+		c.pine_tree = c.tree;
+	if (c.pine_needles == CONTENT_IGNORE)
+		c.pine_needles = c.leaves;
+
+	if (c.tree == CONTENT_IGNORE || c.leaves == CONTENT_IGNORE)
+		spflags &= ~MGV6_TREES;
+	if (spflags & MGV6_TREES) {
+		for (s32 k = 0; k < MGV6_TREE_VARIANTS; k++) {
+			trees.push_back(treegen::make_tree(false, c.tree, c.leaves, c.apple, seed + k));
+			apple_trees.push_back(treegen::make_tree(true, c.tree, c.leaves, c.apple, seed + k));
+			jungle_trees.push_back(treegen::make_jungletree(c.jungletree, c.jungleleaves, seed + k));
+			pine_trees.push_back(treegen::make_pine_tree(c.pine_tree, c.pine_needles, c.snow, seed + k));
+		}
+	}
 }
 
 
 MapgenV6::~MapgenV6()
 {
+	delete noise_terrain;
 	delete noise_terrain_base;
 	delete noise_terrain_higher;
 	delete noise_steepness;
@@ -132,7 +176,11 @@ MapgenV6::~MapgenV6()
 	delete noise_beach;
 	delete noise_biome;
 	delete noise_humidity;
+	delete noise_cave1;
+	delete noise_cave2;
+	delete noise_trees;
 
+	delete[] terrain_level;
 	delete[] heightmap;
 }
 
@@ -146,6 +194,10 @@ MapgenV6Params::MapgenV6Params():
 	np_beach          (0,    1.0,  v3f(250.0, 250.0, 250.0), 59420,  3, 0.50, 2.0),
 	np_biome          (0,    1.0,  v3f(500.0, 500.0, 500.0), 9130,   3, 0.50, 2.0),
 	np_cave           (6,    6.0,  v3f(250.0, 250.0, 250.0), 34329,  3, 0.50, 2.0),
+	np_cave1          (0,    12.0, v3f(61.0,  61.0,  61.0),  52534,  3, 0.50, 2.0,
+		NOISE_FLAG_DEFAULTS | NOISE_FLAG_POINTBUFFER),
+	np_cave2          (0,    12.0, v3f(67.0,  67.0,  67.0),  10325,  3, 0.50, 2.0,
+		NOISE_FLAG_DEFAULTS | NOISE_FLAG_POINTBUFFER),
 	np_humidity       (0.5,  0.5,  v3f(500.0, 500.0, 500.0), 72384,  3, 0.50, 2.0),
 	np_trees          (0,    1.0,  v3f(125.0, 125.0, 125.0), 2,      4, 0.66, 2.0),
 	np_apple_trees    (0,    1.0,  v3f(100.0, 100.0, 100.0), 342902, 3, 0.45, 2.0)
@@ -157,13 +209,29 @@ MapgenV6Params::MapgenV6Params():
 // Returns y one under area minimum if not found
 s16 MapgenV6::find_stone_level(v2s16 p2d)
 {
-	s16 y_nodes_max = vm->MaxEdge.y;
-	s16 y_nodes_min = vm->MinEdge.y;
+	s16 y_nodes_max = full_node_max.y;
+	s16 y_nodes_min = full_node_min.y;
 	s16 level = baseTerrainLevelFromMap(p2d);
 	return glm::clamp<s16>(level, y_nodes_min - 1, y_nodes_max);
 }
 
 
+bool MapgenV6::inFullArea(v3s16 p) const
+{
+	return p.x >= full_node_min.x && p.x <= full_node_max.x &&
+		p.y >= full_node_min.y && p.y <= full_node_max.y &&
+		p.z >= full_node_min.z && p.z <= full_node_max.z;
+}
+
+
+MapNode MapgenV6::getFullAreaIgn(v3s16 p) const
+{
+	if (!inFullArea(p))
+		return {CONTENT_IGNORE};
+	return vm->get_r(p);
+}
+
+
 // Required by mapgen.h
 bool MapgenV6::block_is_underground(u64 seed, v3s16 blockpos)
 {
@@ -240,13 +308,8 @@ float MapgenV6::baseTerrainLevelFromMap(int index)
 	if (spflags & MGV6_FLAT)
 		return water_level;
 
-	float terrain_base   = noise_terrain_base->result[index];
-	float terrain_higher = noise_terrain_higher->result[index];
-	float steepness      = noise_steepness->result[index];
-	float height_select  = noise_height_select->result[index];
-
-	return baseTerrainLevel(terrain_base, terrain_higher,
-							steepness, height_select);
+	// Computed along with the noise, see calculateTerrainNoise
+	return terrain_level[index];
 }
 
 
@@ -331,6 +394,17 @@ float MapgenV6::getTreeAmount(v2s16 p)
 }
 
 
+float MapgenV6::getTreeAmount(int index)
+{
+	float noise = noise_trees->result[index];
+	float zeroval = -0.39;
+	if (noise < zeroval)
+		return 0;
+
+	return 0.04 * (noise - zeroval) / (1.0 - zeroval);
+}
+
+
 bool MapgenV6::getHaveAppleTree(v2s16 p)
 {
 	/*is_apple_tree = noise2d_perlin(
@@ -422,7 +496,7 @@ u32 MapgenV6::get_blockseed(u64 seed, v3s16 p)
 
 //////////////////////// Map generator
 
-void MapgenV6::makeChunk(BlockMakeData *data)
+void MapgenV6::prepareChunk(BlockMakeData *data)
 {
 	// Pre-conditions
 	assert(data->vmanip);
@@ -451,47 +525,62 @@ void MapgenV6::makeChunk(BlockMakeData *data)
 	full_node_max = node_max + CHUNK_PADDING;
 
 	central_area_size = node_max - node_min + v3s16(1, 1, 1);
-	assert(central_area_size.x == central_area_size.z);
+	if (central_area_size != csize)
+		throw std::invalid_argument("Chunk size differs from the one the mapgen was set up for");
 
 	// Create a block-specific seed
 	blockseed = get_blockseed(data->seed, node_min - MAP_BLOCKSIZE);
+}
+
+
+void MapgenV6::makeChunk(BlockMakeData *data)
+{
+	ScopeProfiler sp(g_profiler, "MapgenV6: makeChunk");
+	prepareChunk(data);
 
 	// Make some noise
 	calculateNoise();
 
 	// Maximum height of the stone surface and obstacles.
-	// This is used to guide the cave generation
+	// This is used to limit the cave generation
 	s16 stone_surface_max_y;
 
-	// Generate general ground level to full area
-	stone_surface_max_y = generateGround();
-
-	// Create initial heightmap to limit caves
-	updateHeightmap(node_min, node_max);
-
-	const s16 max_spread_amount = MAP_BLOCKSIZE;
-	// Limit dirt flow area by 1 because mud is flown into neighbors.
-	s16 mudflow_minpos = -max_spread_amount + 1;
-	s16 mudflow_maxpos = central_area_size.x + max_spread_amount - 2;
-
-	// Loop this part, it will make stuff look older and newer nicely
-	const u32 age_loops = 2;
-	for (u32 i_age = 0; i_age < age_loops; i_age++) { // Aging loop
-		// Make caves (this code is relatively horrible)
-// 		if (flags & MG_CAVES)
-// 			generateCaves(stone_surface_max_y);
-
-		// Add mud to the central chunk
-		addMud();
-
-		// Flow mud away from steep edges
-// 		if (spflags & MGV6_MUDFLOW)
-// 			flowMud(mudflow_minpos, mudflow_maxpos);
-
+	// Chunks entirely above or below the terrain surface are filled in
+	// bulk, none of the surface stages would change them
+	ChunkClass chunk_class = classifyChunk(&stone_surface_max_y);
+	bool lit = false;
+	if (chunk_class != CHUNK_MIXED) {
+		lit = generateBulk(chunk_class);
+	} else {
+		// Generate general ground level to full area
+		generateGround();
+
+		// generateGround created the initial heightmap to limit caves,
+		// addMud and flowMud keep it up to date
+
+		const s16 max_spread_amount = MAP_BLOCKSIZE;
+		// Limit dirt flow area by 1 because mud is flown into neighbors,
+		// and to the manip, which the padding may not fill
+		s16 mudflow_minpos = std::max<s16>(-max_spread_amount + 1,
+			full_node_min.x - node_min.x);
+		s16 mudflow_maxpos = std::min<s16>(central_area_size.x + max_spread_amount - 2,
+			full_node_max.x - node_min.x);
+
+		// Loop this part, it will make stuff look older and newer nicely
+		const u32 age_loops = 2;
+		for (u32 i_age = 0; i_age < age_loops; i_age++) { // Aging loop
+			// Add mud to the central chunk
+			addMud();
+
+			// Flow mud away from steep edges
+			if (spflags & MGV6_MUDFLOW)
+				flowMud(mudflow_minpos, mudflow_maxpos);
+		}
 	}
 
-	// Update heightmap after mudflow
-	updateHeightmap(node_min, node_max);
+	// Make caves, after the mud, which flowMud expects on solid columns
+	if (flags & MG_CAVES)
+		generateCaves(stone_surface_max_y);
 
 	// Add dungeons
 	if ((flags & MG_DUNGEONS) && stone_surface_max_y >= node_min.y &&
@@ -548,11 +637,12 @@ void MapgenV6::makeChunk(BlockMakeData *data)
 // 	updateLiquid(&data->transforming_liquid, full_node_min, full_node_max);
 
 	// Add surface nodes
-	growGrass();
+	if (chunk_class == CHUNK_MIXED)
+		growGrass();
 
 	// Generate some trees, and add grass, if a jungle
-// 	if (spflags & MGV6_TREES)
-// 		placeTreesAndJungleGrass();
+	if ((spflags & MGV6_TREES) && chunk_class == CHUNK_MIXED)
+		placeTreesAndJungleGrass();
 
 	// Generate the registered decorations
 // 	if (flags & MG_DECORATIONS)
@@ -561,135 +651,495 @@ void MapgenV6::makeChunk(BlockMakeData *data)
 	// Generate the registered ores
 // 	m_emerge->oremgr->placeAllOres(this, blockseed, node_min, node_max);
 
-	// Calculate lighting
-// 	if (flags & MG_LIGHT)
-// 		calcLighting(node_min - v3s16(1, 1, 1) * MAP_BLOCKSIZE,
-// 			node_max + v3s16(1, 0, 1) * MAP_BLOCKSIZE,
-// 			full_node_min, full_node_max);
+	// Calculate lighting, which also crosses the faces of the chunk. Where
+	// the chunk above is not there to tell, the ground goes on above the
+	// stone chunks, and above some columns of the mixed ones, so no
+	// sunlight comes from there. The air chunks filled in bulk are all in
+	// the sun already; the light they would spread to the chunks around is
+	// left out for now.
+	if ((flags & MG_LIGHT) && !lit) {
+		if (chunk_class == CHUNK_STONE)
+			calcLighting(node_min, node_max, true);
+		else
+			calcLighting(node_min, node_max, false, terrainSurface());
+	}
 
 	this->generating = false;
 }
 
 
+const s16 *MapgenV6::terrainSurface()
+{
+	terrain_surface.resize(csize.x * csize.z);
+	for (u32 index = 0; index < terrain_surface.size(); index++)
+		terrain_surface[index] = baseTerrainLevelFromMap(index);
+	return terrain_surface.data();
+}
+
+
 void MapgenV6::calculateNoise()
 {
+	ScopeProfiler sp(g_profiler, "MapgenV6: calculateNoise");
 	int x = node_min.x;
 	int z = node_min.z;
 	int fx = full_node_min.x;
 	int fz = full_node_min.z;
 
-	if (!(spflags & MGV6_FLAT)) {
-		noise_terrain_base->perlinMap2D_PO(x, 0.5, z, 0.5);
-		noise_terrain_higher->perlinMap2D_PO(x, 0.5, z, 0.5);
-		noise_steepness->perlinMap2D_PO(x, 0.5, z, 0.5);
-		noise_height_select->perlinMap2D_PO(x, 0.5, z, 0.5);
-		noise_mud->perlinMap2D_PO(x, 0.5, z, 0.5);
-	}
+	if (!(spflags & MGV6_FLAT))
+		calculateTerrainNoise(x, z);
 
-	noise_beach->perlinMap2D_PO(x, 0.2, z, 0.7);
+	calculateNoiseMap(noise_beach, x, 0.2, z, 0.7);
 
-	noise_biome->perlinMap2D_PO(fx, 0.6, fz, 0.2);
-	noise_humidity->perlinMap2D_PO(fx, 0.0, fz, 0.0);
+	calculateNoiseMap(noise_biome, fx, 0.6, fz, 0.2);
+	calculateNoiseMap(noise_humidity, fx, 0.0, fz, 0.0);
 	// Humidity map does not need range limiting 0 to 1,
 	// only humidity at point does
 }
 
 
+void MapgenV6::calculateTerrainNoise(float x, float z)
+{
+	Noise *maps[] = {noise_terrain_base, noise_terrain_higher,
+		noise_steepness, noise_height_select, noise_mud};
+
+	auto compute_levels = [this] (u32 begin, u32 end) {
+		for (u32 index = begin; index != end; index++) {
+			terrain_level[index] = baseTerrainLevel(
+				noise_terrain_base->result[index],
+				noise_terrain_higher->result[index],
+				noise_steepness->result[index],
+				noise_height_select->result[index]);
+		}
+	};
+
+	bool cached = noise_cache;
+	for (Noise *noise : maps) {
+		if (!cached)
+			break;
+		cached = noise_cache->fetch(noise,
+			x + 0.5f * noise->np.spread.x, z + 0.5f * noise->np.spread.y);
+	}
+	if (cached) {
+		compute_levels(0, csize.x * csize.z);
+		return;
+	}
+
+	noise_terrain->perlinMap2D_PO(x, 0.5, z, 0.5, compute_levels);
+	if (noise_cache) {
+		for (Noise *noise : maps)
+			noise_cache->store(noise,
+				x + 0.5f * noise->np.spread.x, z + 0.5f * noise->np.spread.y);
+	}
+}
+
+
+// All the maps are 2D, so chunks above each other can share them
+void MapgenV6::calculateNoiseMap(Noise *noise,
+	float x, float xoff, float z, float zoff)
+{
+	if (noise_cache)
+		noise_cache->perlinMap2D_PO(noise, x, xoff, z, zoff);
+	else
+		noise->perlinMap2D_PO(x, xoff, z, zoff);
+}
+
+
+// Sets the qubes not generated yet (CONTENT_IGNORE) to n.
+// Returns whether all of them were such.
+static bool fill_ignored(MapNode *begin, int count, MapNode n)
+{
+	int kept = 0;
+	for (MapNode *q = begin; q != begin + count; q++) {
+		if (q->content == CONTENT_IGNORE)
+			*q = n;
+		else
+			kept++;
+	}
+	return kept == 0;
+}
+
+
 int MapgenV6::generateGround()
 {
-	//TimeTaker timer1("Generating ground level");
+	ScopeProfiler sp(g_profiler, "MapgenV6: generateGround");
 	MapNode n_air{CONTENT_AIR}, n_water_source{c.water_source};
 	MapNode n_stone{c.stone}, n_desert_stone{c.desert_stone};
 	MapNode n_ice{c.ice};
 	int stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
 
-	u32 index = 0;
-	for (s16 z = node_min.z; z <= node_max.z; z++)
-	for (s16 x = node_min.x; x <= node_max.x; x++, index++) {
-		// Surface height
+	std::mutex mutex;
+	forRows(node_min.z, node_max.z, [&] (s16 z_min, s16 z_max) {
+		// A column, bottom up, as runs of the same node ending at `top`
+		struct Run {
+			int top;
+			MapNode n;
+		} runs[5];
+
+		u32 index = (z_min - node_min.z) * ystride;
+		int max_y = -MAX_MAP_GENERATION_LIMIT;
+		for (s16 z = z_min; z <= z_max; z++)
+		for (s16 x = node_min.x; x <= node_max.x; x++, index++) {
+			// Surface height
+			s16 surface_y = (s16)baseTerrainLevelFromMap(index);
+
+			// Log it
+			if (surface_y > max_y)
+				max_y = surface_y;
+
+			BiomeV6Type bt = getBiome(v2s16(x, z));
+
+			// Stone up to the surface, water up to the water level, air above.
+			// Runs ending below the previous one are empty.
+			int count = 0;
+			if (bt == BT_DESERT) {
+				runs[count++] = {std::min<int>(surface_y, MGV6_DESERT_STONE_BASE - 1), n_stone};
+				runs[count++] = {surface_y, n_desert_stone};
+			} else {
+				runs[count++] = {surface_y, n_stone};
+			}
+			if (bt == BT_TUNDRA) {
+				runs[count++] = {std::min<int>(water_level, MGV6_ICE_BASE - 1), n_water_source};
+				runs[count++] = {water_level, n_ice};
+			} else {
+				runs[count++] = {water_level, n_water_source};
+			}
+			runs[count++] = {node_max.y, n_air};
+
+			// Fill ground with stone
+			bool fresh = true;
+			Run const *run = runs;
+			for (int y = node_min.y; y <= node_max.y; ) {
+				MMVManip::Span span = vm->column_rw({x, y, z});
+				int span_top = std::min<int>(y + span.size - 1, node_max.y);
+				for (MapNode *q = span.begin; y <= span_top; ) {
+					while (run->top < y)
+						run++;
+					int top = std::min(run->top, span_top);
+					fresh &= fill_ignored(q, top - y + 1, run->n);
+					q += top - y + 1;
+					y = top + 1;
+				}
+			}
+
+			// Initial heightmap. Unless something was there already, the column
+			// is all stone and water up to the higher of them
+			s16 ground_y = std::max<s16>(surface_y, water_level);
+			if (!fresh)
+				heightmap[index] = findGroundLevel(v2s16(x, z), node_min.y, node_max.y);
+			else if (ground_y < node_min.y)
+				heightmap[index] = -MAX_MAP_GENERATION_LIMIT;
+			else
+				heightmap[index] = std::min<s16>(ground_y, node_max.y);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stone_surface_max_y = std::max(stone_surface_max_y, max_y);
+	});
+
+	return stone_surface_max_y;
+}
+
+
+MapgenV6::ChunkClass MapgenV6::classifyChunk(s16 *surface_max_y)
+{
+	int min_y = MAX_MAP_GENERATION_LIMIT;
+	int max_y = -MAX_MAP_GENERATION_LIMIT;
+	for (int index = 0; index < csize.x * csize.z; index++) {
 		s16 surface_y = (s16)baseTerrainLevelFromMap(index);
+		min_y = std::min<int>(min_y, surface_y);
+		max_y = std::max<int>(max_y, surface_y);
+	}
+	*surface_max_y = max_y;
+
+	// The padding is not covered by the terrain maps
+	if (CHUNK_PADDING != 0)
+		return CHUNK_MIXED;
+	// addMud only adds mud where the stone surface is inside the manip, and
+	// growGrass only changes the dirt and stone on the surface
+	if (max_y < full_node_min.y)
+		return water_level < node_min.y ? CHUNK_AIR : CHUNK_WATER_AIR;
+	if (min_y >= full_node_max.y)
+		return CHUNK_STONE;
+	return CHUNK_MIXED;
+}
 
-		// Log it
-		if (surface_y > stone_surface_max_y)
-			stone_surface_max_y = surface_y;
-
-		BiomeV6Type bt = getBiome(v2s16(x, z));
-
-		// Fill ground with stone
-		for (s16 y = node_min.y; y <= node_max.y; y++) {
-			if (vm->get_r({x, y, z}).content == CONTENT_IGNORE) {
-				Qube &q = vm->get_rw({x, y, z});
-				if (y <= surface_y)
-					q = (y >= MGV6_DESERT_STONE_BASE && bt == BT_DESERT) ? n_desert_stone : n_stone;
-				else if (y <= water_level)
-					q = (y >= MGV6_ICE_BASE && bt == BT_TUNDRA) ? n_ice : n_water_source;
-				else
-					q = n_air;
-			}
+
+bool MapgenV6::generateBulk(ChunkClass chunk_class)
+{
+	ScopeProfiler sp(g_profiler, "MapgenV6: generateBulk");
+	bool uniform = chunk_class == CHUNK_AIR;
+	if (chunk_class == CHUNK_STONE) {
+		// Deserts have desert stone above MGV6_DESERT_STONE_BASE
+		uniform = true;
+		if (node_max.y >= MGV6_DESERT_STONE_BASE) {
+			for (s16 z = node_min.z; z <= node_max.z && uniform; z++)
+			for (s16 x = node_min.x; x <= node_max.x && uniform; x++)
+				uniform = getBiome(v2s16(x, z)) != BT_DESERT;
 		}
 	}
+	if (!uniform) {
+		generateGround();
+		return false;
+	}
 
-	return stone_surface_max_y;
+	// All the air of these is in the sun
+	MapNode n = chunk_class == CHUNK_AIR ? MapNode{CONTENT_AIR, LIGHT_SUN} : MapNode{c.stone};
+	glm::ivec3 bmin = vm->split(mt_to_vcore(node_min)).first;
+	glm::ivec3 bmax = vm->split(mt_to_vcore(node_max)).first;
+	bool fresh = true;
+	for (glm::ivec3 pos : space_range{bmin, bmax + 1})
+		fresh &= fill_ignored(vm->getBlock(pos).qube, block_data_size, n);
+
+	if (!fresh)
+		updateHeightmap(node_min, node_max);
+	else
+		std::fill_n(heightmap, csize.x * csize.z,
+			chunk_class == CHUNK_AIR ? -MAX_MAP_GENERATION_LIMIT : node_max.y);
+	return fresh && chunk_class == CHUNK_AIR;
 }
 
 
 void MapgenV6::addMud()
 {
 	// 15ms @cs=8
-	//TimeTaker timer1("add mud");
+	ScopeProfiler sp(g_profiler, "MapgenV6: addMud");
 	MapNode n_dirt{c.dirt}, n_gravel{c.gravel};
 	MapNode n_sand{c.sand}, n_desert_sand{c.desert_sand};
-	MapNode addnode;
-
-	u32 index = 0;
-	for (s16 z = node_min.z; z <= node_max.z; z++)
-	for (s16 x = node_min.x; x <= node_max.x; x++, index++) {
-		// Randomize mud amount
-		s16 mud_add_amount = getMudAmount(index) / 2.0 + 0.5;
-
-		// Find ground level
-		s16 surface_y = find_stone_level(v2s16(x, z));
-
-		// Handle area not found
-		if (surface_y == vm->MinEdge.y - 1)
-			continue;
-
-		BiomeV6Type bt = getBiome(v2s16(x, z));
-		addnode = (bt == BT_DESERT) ? n_desert_sand : n_dirt;
-
-		if (bt == BT_DESERT && surface_y + mud_add_amount <= water_level + 1) {
-			addnode = n_sand;
-		} else if (mud_add_amount <= 0) {
-			mud_add_amount = 1 - mud_add_amount;
-			addnode = n_gravel;
-		} else if (bt != BT_DESERT && getHaveBeach(index) &&
-				surface_y + mud_add_amount <= water_level + 2) {
-			addnode = n_sand;
+
+	forRows(node_min.z, node_max.z, [&] (s16 z_min, s16 z_max) {
+		u32 index = (z_min - node_min.z) * ystride;
+		for (s16 z = z_min; z <= z_max; z++)
+		for (s16 x = node_min.x; x <= node_max.x; x++, index++) {
+			// Randomize mud amount
+			s16 mud_add_amount = getMudAmount(index) / 2.0 + 0.5;
+
+			// Find ground level
+			s16 surface_y = find_stone_level(v2s16(x, z));
+
+			// Handle area not found
+			if (surface_y == full_node_min.y - 1)
+				continue;
+
+			BiomeV6Type bt = getBiome(v2s16(x, z));
+			MapNode addnode = (bt == BT_DESERT) ? n_desert_sand : n_dirt;
+
+			if (bt == BT_DESERT && surface_y + mud_add_amount <= water_level + 1) {
+				addnode = n_sand;
+			} else if (mud_add_amount <= 0) {
+				mud_add_amount = 1 - mud_add_amount;
+				addnode = n_gravel;
+			} else if (bt != BT_DESERT && getHaveBeach(index) &&
+					surface_y + mud_add_amount <= water_level + 2) {
+				addnode = n_sand;
+			}
+
+			if ((bt == BT_DESERT || bt == BT_TUNDRA) && surface_y > 20)
+				mud_add_amount = std::max(0, mud_add_amount - (surface_y - 20) / 5);
+
+			/* If topmost node is grass, change it to mud.  It might be if it was
+			// flown to there from a neighboring chunk and then converted.
+			u32 i = vm->m_area.index(x, surface_y, z);
+			if (vm->m_data[i].getContent() == c.dirt_with_grass)
+				vm->m_data[i] = n_dirt;*/
+
+			// Add mud on ground
+			s16 mudcount = 0;
+			s16 y_start = surface_y + 1;
+			for (s16 y = y_start; y <= node_max.y; y++) {
+				if (mudcount >= mud_add_amount)
+					break;
+				vm->get_rw({x, y, z}) = addnode;
+				mudcount++;
+			}
+
+			// Mud is walkable, so it may only raise the ground
+			s16 mud_top_y = y_start + mudcount - 1;
+			if (mudcount > 0 && mud_top_y >= node_min.y && mud_top_y > heightmap[index])
+				heightmap[index] = mud_top_y;
 		}
+	});
+}
 
-		if ((bt == BT_DESERT || bt == BT_TUNDRA) && surface_y > 20)
-			mud_add_amount = std::max(0, mud_add_amount - (surface_y - 20) / 5);
 
-		/* If topmost node is grass, change it to mud.  It might be if it was
-		// flown to there from a neighboring chunk and then converted.
-		u32 i = vm->m_area.index(x, surface_y, z);
-		if (vm->m_data[i].getContent() == c.dirt_with_grass)
-			vm->m_data[i] = n_dirt;*/
+void MapgenV6::flowMud(s16 &mudflow_minpos, s16 &mudflow_maxpos)
+{
+	ScopeProfiler sp(g_profiler, "MapgenV6: flowMud");
+	// The heightmap does not cover the padding
+	if (CHUNK_PADDING != 0) {
+		flowMudReference(mudflow_minpos, mudflow_maxpos);
+		updateHeightmap(node_min, node_max);
+		return;
+	}
 
-		// Add mud on ground
-		s16 mudcount = 0;
-		s16 y_start = surface_y + 1;
-		for (s16 y = y_start; y <= node_max.y; y++) {
-			if (mudcount >= mud_add_amount)
-				break;
-			vm->get_rw({x, y, z}) = addnode;
-			mudcount++;
+	// In a solid column only the top node has anything but ground above,
+	// and only mud there may flow. It flows to the first side whose ground
+	// is 2 or more nodes lower, landing on top of it: the heightmap tells
+	// all that without scanning the columns. Then moveMud never finds
+	// decorations to remove, as above the tops there is only air.
+	// The sweeps are the same as in flowMudReference, so is the order of
+	// the moves, but only the columns next to a change since the last look
+	// are looked at again.
+
+	// The heightmap, and whether the top of each column is stuck, with a
+	// border of columns too high to flow to, for the sides to need no
+	// bounds checks. A column whose top was found not to flow for what it
+	// is, not mud or mud on something else, is stuck until mud lands on
+	// it: lowering the sides does not make it a candidate again.
+	const int size_x = csize.x, size_z = csize.z;
+	const int stride = size_x + 2;
+	const s16 y_min = node_min.y;
+	mudflow_heights.assign(stride * (size_z + 2), MAX_MAP_GENERATION_LIMIT + 2);
+	mudflow_stuck.assign(stride * (size_z + 2), 0);
+	int *const height = mudflow_heights.data() + stride + 1;
+	u8 *const stuck = mudflow_stuck.data() + stride + 1;
+	for (int rz = 0; rz < size_z; rz++)
+		std::copy_n(&heightmap[rz * ystride], size_x, &height[rz * stride]);
+
+	// The columns to look at, a bit each in rows of words with the border,
+	// for the sweeps to skip the others a word at a time
+	const int words = (stride + 63) / 64;
+	mudflow_candidates.assign(words * (size_z + 2), 0);
+	auto candidate_row = [&] (int rz) {
+		return mudflow_candidates.data() + words * (rz + 1);
+	};
+	auto mark = [&] (int rx, int rz) {
+		candidate_row(rz)[(rx + 1) >> 6] |= u64(1) << ((rx + 1) & 63);
+	};
+
+	// Sides in the order of dirs4, as steps of the column index
+	const int side_dx[4] = {0, 1, 0, -1};
+	const int side_dz[4] = {1, 0, -1, 0};
+	const int side_step[4] = {stride, 1, -stride, -1};
+	// The side the top of a column would drop to, or -1
+	auto drop_side = [&] (int index) {
+		int y = height[index];
+		if (y - 1 < y_min)
+			return -1;
+		for (int d = 0; d < 4; d++)
+			if (height[index + side_step[d]] <= y - 2)
+				return d;
+		return -1;
+	};
+	// Sides of a column that may now flow onto it, having been lowered;
+	// the others are as they were
+	auto mark_above = [&] (int rx, int rz, int index) {
+		for (int d = 0; d < 4; d++) {
+			int side_index = index + side_step[d];
+			if (!stuck[side_index] && height[side_index] >= height[index] + 2)
+				mark(rx + side_dx[d], rz + side_dz[d]);
 		}
+	};
+
+	// The chunk starts a block, so the offsets from node_min split into
+	// blocks by bits
+	const glm::ivec3 bstart = vm->split(mt_to_vcore(node_min)).first;
+	const glm::ivec3 bsize = mt_to_vcore(csize) / MAP_BLOCKSIZE;
+	mudflow_blocks.resize(bsize.x * bsize.y * bsize.z);
+	for (auto pos: space_range{bstart, bstart + bsize}) {
+		glm::ivec3 rel = pos - bstart;
+		mudflow_blocks[rel.x + bsize.x * (rel.y + bsize.y * rel.z)] = &vm->getBlock(pos);
 	}
+	Block *const *blocks = mudflow_blocks.data();
+	auto node = [&] (int rx, int y, int rz) -> MapNode & {
+		int ry = y - y_min;
+		Block *block = blocks[(rx >> 4) + bsize.x * ((rz >> 4) + bsize.y * (ry >> 4))];
+		return block->qube[Block::index_unsafe({rx & 15, rz & 15, ry & 15})];
+	};
+	const content_t c_dirt = c.dirt, c_gravel = c.gravel, c_grass = c.dirt_with_grass;
+
+	// At first, the columns with any side 2 or more lower
+	for (int rz = 0; rz < size_z; rz++)
+	for (int rx = 0; rx < size_x; rx++) {
+		int index = rz * stride + rx;
+		int lowest = std::min(std::min(height[index + stride], height[index + 1]),
+			std::min(height[index - stride], height[index - 1]));
+		if (height[index] - 1 >= y_min && lowest <= height[index] - 2)
+			mark(rx, rz);
+	}
+
+	// The sweeps of flowMudReference, relative to node_min and limited to
+	// the chunk; every 2nd one goes backwards
+	int lo = std::max<int>(mudflow_minpos, 0);
+	int hi_x = std::min<int>(mudflow_maxpos, size_x - 1);
+	int hi_z = std::min<int>(mudflow_maxpos, size_z - 1);
+	for (s16 k = 0; k < 3; k++) {
+		bool backwards = k % 2 == 0;
+		for (int z = lo; z <= hi_z; z++) {
+			int rz = backwards ? lo + hi_z - z : z;
+			u64 *row = candidate_row(rz);
+			for (int rx = backwards ? hi_x : lo;; rx += backwards ? -1 : 1) {
+				// On to the next candidate in the sweep, which the moves so
+				// far may have marked
+				int b = rx + 1;
+				if (backwards) {
+					u64 w = row[b >> 6] << (63 - (b & 63));
+					if (!w) {
+						rx = (b & ~63) - 1;
+						if (rx <= lo)
+							break;
+						continue;
+					}
+					rx -= __builtin_clzll(w);
+					if (rx < lo)
+						break;
+				} else {
+					u64 w = row[b >> 6] >> (b & 63);
+					if (!w) {
+						rx = (b | 63) - 1;
+						if (rx >= hi_x)
+							break;
+						continue;
+					}
+					rx += __builtin_ctzll(w);
+					if (rx > hi_x)
+						break;
+				}
+				int index = rz * stride + rx;
+
+				// Flow mud off the top while there is some that flows
+				int y = height[index];
+				u8 blocked = 0;
+				for (;;) {
+					int d = drop_side(index);
+					if (d < 0)
+						break;
+					MapNode &n = node(rx, y, rz);
+					blocked = 1;
+					if (n.content != c_dirt && n.content != c_gravel)
+						break;
+					// Don't flow it if the stuff under it is not mud
+					if (n.content == c_dirt) {
+						content_t under = node(rx, y - 1, rz).content;
+						if (under != c_dirt && under != c_grass)
+							break;
+					}
+					blocked = 0;
+					int side_index = index + side_step[d];
+					// Dropped to below the manip, stays in place
+					if (height[side_index] < y_min)
+						break;
+					int side_rx = rx + side_dx[d];
+					int side_rz = rz + side_dz[d];
+					node(side_rx, ++height[side_index], side_rz) = n;
+					n = MapNode{CONTENT_AIR};
+					height[index] = --y;
+					// The side might flow on now, having been raised
+					stuck[side_index] = 0;
+					mark(side_rx, side_rz);
+					mark_above(rx, rz, index);
+				}
+				stuck[index] = blocked;
+				row[(rx + 1) >> 6] &= ~(u64(1) << ((rx + 1) & 63));
+			}
+		}
+	}
+
+	for (int rz = 0; rz < size_z; rz++)
+		std::copy_n(&height[rz * stride], size_x, &heightmap[rz * ystride]);
 }
 
 
-void MapgenV6::flowMud(s16 &mudflow_minpos, s16 &mudflow_maxpos)
+void MapgenV6::flowMudReference(s16 &mudflow_minpos, s16 &mudflow_maxpos)
 {
 	// 340ms @cs=8
 	//TimeTaker timer1("flow mud");
@@ -744,8 +1194,8 @@ void MapgenV6::flowMud(s16 &mudflow_minpos, s16 &mudflow_maxpos)
 
 				// Check that upper is walkable. Cancel
 				// dropping if upper keeps it in place.
-				glm::vec3 p3{p2d.x, y + 1, p2d.y};
-				if (is_walkable(vm->get_ign(p3).content))
+				glm::ivec3 p3{p2d.x, y + 1, p2d.y};
+				if (is_walkable(getFullAreaIgn(p3).content))
 					continue;
 
 				// Drop mud on side
@@ -754,7 +1204,7 @@ void MapgenV6::flowMud(s16 &mudflow_minpos, s16 &mudflow_maxpos)
 					// Move to side
 					p2 += dirp;
 					// Fail if out of area
-					if (!vm->in_area(p2))
+					if (!inFullArea(p2))
 						continue;
 					// Check that side is air
 					MapNode n2 = vm->get_r(p2);
@@ -762,7 +1212,7 @@ void MapgenV6::flowMud(s16 &mudflow_minpos, s16 &mudflow_maxpos)
 						continue;
 					// Check that under side is air
 					p2.y--;
-					if (!vm->in_area(p2))
+					if (!inFullArea(p2))
 						continue;
 					n2 = vm->get_r(p2);
 					if (is_walkable(n2.content))
@@ -771,7 +1221,7 @@ void MapgenV6::flowMud(s16 &mudflow_minpos, s16 &mudflow_maxpos)
 					bool dropped_to_unknown = false;
 					do {
 						p2.y--;
-						n2 = vm->get_ign(p2);
+						n2 = getFullAreaIgn(p2);
 						if (n2.content == CONTENT_IGNORE) {
 							dropped_to_unknown = true;
 							break;
@@ -813,7 +1263,7 @@ void MapgenV6::moveMud(v3s16 remove_index, v3s16 place_index,
 		// Check for 'ignore' because stacked decorations can penetrate into
 		// 'ignore' nodes above the mapchunk.
 		for (;;) {
-			content_t above_remove = vm->get_ign(above_remove_index).content;
+			content_t above_remove = getFullAreaIgn(above_remove_index).content;
 			if (above_remove == CONTENT_IGNORE || above_remove == CONTENT_AIR || above_remove == c.water_source)
 				break;
 			vm->get_rw(above_remove_index) = n_air;
@@ -823,7 +1273,7 @@ void MapgenV6::moveMud(v3s16 remove_index, v3s16 place_index,
 		// above and remove.
 		for (;;) {
 			place_index.y++;
-			content_t place = vm->get_ign(place_index).content;
+			content_t place = getFullAreaIgn(place_index).content;
 			if (place == CONTENT_IGNORE || place == CONTENT_AIR || place == c.water_source)
 				break;
 			vm->get_rw(place_index) = n_air;
@@ -831,26 +1281,32 @@ void MapgenV6::moveMud(v3s16 remove_index, v3s16 place_index,
 	}
 }
 
-/*
 void MapgenV6::placeTreesAndJungleGrass()
 {
-	//TimeTaker t("placeTrees");
+	ScopeProfiler sp(g_profiler, "MapgenV6: placeTreesAndJungleGrass");
 	if (node_max.y < water_level)
 		return;
 
+	// Seeded by the chunk, not shared between chunks, for the trees not to
+	// depend on the order chunks are generated in
 	PseudoRandom grassrandom(blockseed + 53);
-	content_t c.junglegrass = ndef->getId("mapgen_junglegrass");
-	// if we don't have junglegrass, don't place cignore... that's bad
-	if (c.junglegrass == CONTENT_IGNORE)
-		c.junglegrass = CONTENT_AIR;
+	PseudoRandom treerandom(blockseed);
 	MapNode n_junglegrass{c.junglegrass};
-	const v3s16 &em = vm->m_area.getExtent();
+
+	// Trees and grass go on the ground as it was before any of them, but
+	// the heightmap is kept up to date
+	tree_ground.assign(heightmap, heightmap + csize.x * csize.z);
 
 	// Divide area into parts
-	s16 div = 8;
+	s16 div = MGV6_TREE_DIVISIONS;
 	s16 sidelen = central_area_size.x / div;
 	double area = sidelen * sidelen;
 
+	// Tree amount at the center of each part, in one batch
+	noise_trees->perlinMap2D(
+		(node_min.x + sidelen / 2) / (float)sidelen,
+		(node_min.z + sidelen / 2) / (float)sidelen);
+
 	// N.B.  We must add jungle grass first, since tree leaves will
 	// obstruct the ground, giving us a false ground level
 	for (s16 z0 = 0; z0 < div; z0++)
@@ -877,7 +1333,7 @@ void MapgenV6::placeTreesAndJungleGrass()
 		// Amount of trees
 		u32 tree_count;
 		if (bt == BT_JUNGLE || bt == BT_TAIGA || bt == BT_NORMAL) {
-			tree_count = area * getTreeAmount(p2d_center);
+			tree_count = area * getTreeAmount(z0 * div + x0);
 			if (bt == BT_JUNGLE)
 				tree_count *= 4;
 		} else {
@@ -893,106 +1349,186 @@ void MapgenV6::placeTreesAndJungleGrass()
 				s16 z = grassrandom.range(p2d_min.y, p2d_max.y);
 				int mapindex = central_area_size.x * (z - node_min.z)
 								+ (x - node_min.x);
-				s16 y = heightmap[mapindex];
-				if (y < water_level)
+				s16 y = tree_ground[mapindex];
+				if (y < water_level || y >= node_max.y)
 					continue;
 
-				u32 vi = vm->m_area.index(x, y, z);
 				// place on dirt_with_grass, since we know it is exposed to sunlight
-				if (vm->m_data[vi].getContent() == c.dirt_with_grass) {
-					VoxelArea::add_y(em, vi, 1);
-					vm->m_data[vi] = n_junglegrass;
+				if (vm->get_r({x, y, z}).content == c.dirt_with_grass) {
+					vm->get_rw({x, y + 1, z}) = n_junglegrass;
+					heightmap[mapindex] = std::max<s16>(heightmap[mapindex], y + 1);
 				}
 			}
 		}
 
 		// Put trees in random places on part of division
 		for (u32 i = 0; i < tree_count; i++) {
-			s16 x = myrand_range(p2d_min.x, p2d_max.x);
-			s16 z = myrand_range(p2d_min.y, p2d_max.y);
+			s16 x = treerandom.range(p2d_min.x, p2d_max.x);
+			s16 z = treerandom.range(p2d_min.y, p2d_max.y);
 			int mapindex = central_area_size.x * (z - node_min.z)
 							+ (x - node_min.x);
-			s16 y = heightmap[mapindex];
+			s16 y = tree_ground[mapindex];
 			// Don't make a tree under water level
-			// Don't make a tree so high that it doesn't fit
-			if (y < water_level || y > node_max.y - 6)
+			if (y < water_level)
 				continue;
 
-			v3s16 p(x, y, z);
 			// Trees grow only on mud and grass
-			{
-				u32 i = vm->m_area.index(p);
-				content_t c = vm->m_data[i].getContent();
-				if (c != c.dirt &&
-						c != c.dirt_with_grass &&
-						c != c.dirt_with_snow)
-					continue;
-			}
-			p.y++;
+			content_t c_ground = vm->get_r({x, y, z}).content;
+			if (c_ground != c.dirt &&
+					c_ground != c.dirt_with_grass &&
+					c_ground != c.dirt_with_snow)
+				continue;
 
-			// Make a tree
+			// Pick a tree
+			std::vector<treegen::TreeTemplate> *kinds = &trees;
 			if (bt == BT_JUNGLE) {
-				treegen::make_jungletree(*vm, p, ndef, myrand());
+				kinds = &jungle_trees;
 			} else if (bt == BT_TAIGA) {
-				treegen::make_pine_tree(*vm, p - v3s16(0, 1, 0), ndef, myrand());
-			} else if (bt == BT_NORMAL) {
-				bool is_apple_tree = (myrand_range(0, 3) == 0) &&
+				kinds = &pine_trees;
+			} else {
+				bool is_apple_tree = (treerandom.range(0, 3) == 0) &&
 							getHaveAppleTree(v2s16(x, z));
-				treegen::make_tree(*vm, p, is_apple_tree, ndef, myrand());
+				if (is_apple_tree)
+					kinds = &apple_trees;
+			}
+			const treegen::TreeTemplate &tree =
+				(*kinds)[treerandom.range(0, kinds->size() - 1)];
+
+			// The part of a tree out of the chunk goes to the neighbouring
+			// chunks in the manip, which keep it. A block of them is more
+			// than any tree needs, so none are left out in practice.
+			v3s16 p(x, y + 1, z);
+			v3s16 tree_min = p + tree.min;
+			v3s16 tree_max = tree_min + tree.size - 1;
+			if (!vm->in_area(tree_min) || !vm->in_area(tree_max))
+				continue;
+
+			treegen::place_tree(*vm, tree, p);
+
+			// The top node of each column of the tree is a tree node now, or
+			// was not air already. The heightmap stops at the chunk top.
+			v3s16 in_min = glm::max(tree_min, node_min) - tree_min;
+			v3s16 in_max = glm::min(tree_max, node_max) - tree_min;
+			for (s16 tz = in_min.z; tz <= in_max.z; tz++)
+			for (s16 tx = in_min.x; tx <= in_max.x; tx++) {
+				treegen::TreeTemplate::Column column = tree.columns[tx + tree.size.x * tz];
+				if (column.begin == column.end || column.begin > in_max.y)
+					continue;
+				int index = central_area_size.x * (tree_min.z + tz - node_min.z)
+						+ (tree_min.x + tx - node_min.x);
+				s16 top = tree_min.y + std::min<s16>(column.end - 1, in_max.y);
+				heightmap[index] = std::max<s16>(heightmap[index], top);
 			}
 		}
 	}
 	//printf("placeTreesAndJungleGrass: %dms\n", t.stop());
 }
-*/
+
+
+void MapgenV6::generateCaves(int max_stone_y)
+{
+	ScopeProfiler sp(g_profiler, "MapgenV6: generateCaves");
+	// The noise is only needed up to the highest stone
+	s16 y_max = std::min<int>(node_max.y, max_stone_y);
+	if (y_max < node_min.y)
+		return;
+	u32 rows = y_max - node_min.y + 1;
+	noise_cave1->setSize(csize.x, rows, csize.z);
+	noise_cave2->setSize(csize.x, rows, csize.z);
+	const float *cave1 = noise_cave1->perlinMap3D(node_min.x, node_min.y, node_min.z);
+	const float *cave2 = noise_cave2->perlinMap3D(node_min.x, node_min.y, node_min.z);
+
+	MapNode n_air{CONTENT_AIR};
+	auto is_ground = [&] (content_t n) {
+		return n == c.stone || n == c.desert_stone || n == c.dirt ||
+			n == c.gravel || n == c.sand || n == c.desert_sand;
+	};
+
+	forRows(node_min.z, node_max.z, [&] (s16 z_min, s16 z_max) {
+		u32 index = (z_min - node_min.z) * ystride;
+		for (s16 z = z_min; z <= z_max; z++)
+		for (s16 x = node_min.x; x <= node_max.x; x++, index++) {
+			// The noise maps are x, y, z; a column is every csize.x-th value
+			u32 index3d = (z - node_min.z) * rows * csize.x + (x - node_min.x);
+			bool top_carved = false;
+			for (int y = node_min.y; y <= y_max; ) {
+				MMVManip::Span span = vm->column_rw({x, y, z});
+				int span_top = std::min<int>(y + span.size - 1, y_max);
+				for (MapNode *q = span.begin; y <= span_top; y++, q++, index3d += csize.x) {
+					// d2 is at most 1, so a small d1 alone rules the node out
+					float d1 = contour(cave1[index3d]);
+					if (d1 <= cave_width)
+						continue;
+					float d2 = contour(cave2[index3d]);
+					if (d1 * d2 > cave_width && is_ground(q->content)) {
+						*q = n_air;
+						top_carved |= y == heightmap[index];
+					}
+				}
+			}
+
+			if (top_carved)
+				heightmap[index] = findGroundLevel(v2s16(x, z), node_min.y, heightmap[index]);
+		}
+	});
+}
+
+
 void MapgenV6::growGrass() // Add surface nodes
 {
+	ScopeProfiler sp(g_profiler, "MapgenV6: growGrass");
 	MapNode n_dirt_with_grass{c.dirt_with_grass};
 	MapNode n_dirt_with_snow{c.dirt_with_snow};
 	MapNode n_snowblock{c.snowblock};
 	MapNode n_snow{c.snow};
 
-	u32 index = 0;
-	for (s16 z = full_node_min.z; z <= full_node_max.z; z++)
-	for (s16 x = full_node_min.x; x <= full_node_max.x; x++, index++) {
-		// Find the lowest surface to which enough light ends up to make
-		// grass grow.  Basically just wait until not air and not leaves.
-		s16 surface_y = 0;
-		{
-			s16 y;
-			// Go to ground level
-			for (y = node_max.y; y >= full_node_min.y; y--) {
-				MapNode n = vm->get_r({x, y, z});
-				if (n.content != CONTENT_AIR) // FIXME: non-full-node decorations?
-					break;
-// 				if (ndef->get(n).param_type != CPT_LIGHT ||
-// 						ndef->get(n).liquid_type != LIQUID_NONE ||
-// 						n.getContent() == c.ice)
-// 					break;
+	forRows(full_node_min.z, full_node_max.z, [&] (s16 z_min, s16 z_max) {
+		u32 index = (z_min - full_node_min.z) * (full_node_max.x - full_node_min.x + 1);
+		for (s16 z = z_min; z <= z_max; z++)
+		for (s16 x = full_node_min.x; x <= full_node_max.x; x++, index++) {
+			// Find the lowest surface to which enough light ends up to make
+			// grass grow.  Basically just wait until not air and not leaves.
+			// Within the chunk, that is the heightmap: there is no
+			// CONTENT_IGNORE left, so the first non-air node is walkable.
+			s16 surface_y = -MAX_MAP_GENERATION_LIMIT;
+			if (x >= node_min.x && x <= node_max.x && z >= node_min.z && z <= node_max.z)
+				surface_y = heightmap[(z - node_min.z) * ystride + (x - node_min.x)];
+			if (surface_y == -MAX_MAP_GENERATION_LIMIT) {
+				s16 y;
+				// Go to ground level
+				for (y = node_max.y; y >= full_node_min.y; y--) {
+					MapNode n = vm->get_r({x, y, z});
+					if (n.content != CONTENT_AIR) // FIXME: non-full-node decorations?
+						break;
+	// 				if (ndef->get(n).param_type != CPT_LIGHT ||
+	// 						ndef->get(n).liquid_type != LIQUID_NONE ||
+	// 						n.getContent() == c.ice)
+	// 					break;
+				}
+				surface_y = (y >= full_node_min.y) ? y : full_node_min.y;
 			}
-			surface_y = (y >= full_node_min.y) ? y : full_node_min.y;
-		}
 
-		BiomeV6Type bt = getBiome(index, v2s16(x, z));
-		glm::ivec3 pos = {x, surface_y, z};
-		content_t n = vm->get_r(pos).content;
-		if (surface_y >= water_level - 20) {
-			if (bt == BT_TAIGA && n == c.dirt) {
-				vm->get_rw(pos) = n_dirt_with_snow;
-			} else if (bt == BT_TUNDRA) {
-				if (n == c.dirt) {
-					vm->get_rw(pos) = n_snowblock;
-					pos.y--;
+			BiomeV6Type bt = getBiome(index, v2s16(x, z));
+			glm::ivec3 pos = {x, surface_y, z};
+			content_t n = vm->get_r(pos).content;
+			if (surface_y >= water_level - 20) {
+				if (bt == BT_TAIGA && n == c.dirt) {
 					vm->get_rw(pos) = n_dirt_with_snow;
-				} else if (n == c.stone && surface_y < node_max.y) {
-					pos.y++;
-					vm->get_rw(pos) = n_snowblock;
+				} else if (bt == BT_TUNDRA) {
+					if (n == c.dirt) {
+						vm->get_rw(pos) = n_snowblock;
+						pos.y--;
+						vm->get_rw(pos) = n_dirt_with_snow;
+					} else if (n == c.stone && surface_y < node_max.y) {
+						pos.y++;
+						vm->get_rw(pos) = n_snowblock;
+					}
+				} else if (n == c.dirt) {
+					vm->get_rw(pos) = n_dirt_with_grass;
 				}
-			} else if (n == c.dirt) {
-				vm->get_rw(pos) = n_dirt_with_grass;
 			}
 		}
-	}
+	});
 }
 /*
 void MapgenV6::generateCaves(int max_stone_y)
@@ -24,6 +24,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapgen.hxx"
 #include "noise.hxx"
+#include "noise_cache.hxx"
+#include "task_pool.hxx"
+#include "treegen.hxx"
 
 #define MGV6_AVERAGE_MUD_AMOUNT 4
 #define MGV6_DESERT_STONE_BASE -32
@@ -32,6 +35,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define MGV6_FREQ_SNOW -0.4
 #define MGV6_FREQ_TAIGA 0.5
 #define MGV6_FREQ_JUNGLE 0.5
+#define MGV6_TREE_DIVISIONS 8
+#define MGV6_TREE_VARIANTS 32
 
 //////////// Mapgen V6 flags
 #define MGV6_JUNGLES    0x01
@@ -62,6 +67,7 @@ struct MapgenV6Params : public MapgenParams {
 	float freq_beach = 0.15f;
 	s16 dungeon_ymin = -31000;
 	s16 dungeon_ymax = 31000;
+	float cave_width = 0.09f;
 
 	NoiseParams np_terrain_base;
 	NoiseParams np_terrain_higher;
@@ -71,6 +77,8 @@ struct MapgenV6Params : public MapgenParams {
 	NoiseParams np_beach;
 	NoiseParams np_biome;
 	NoiseParams np_cave;
+	NoiseParams np_cave1;
+	NoiseParams np_cave2;
 	NoiseParams np_humidity;
 	NoiseParams np_trees;
 	NoiseParams np_apple_trees;
@@ -97,6 +105,14 @@ struct MapV6Params {
 	content_t mossycobble        = CONTENT_IGNORE;
 	content_t stair_cobble       = CONTENT_IGNORE;
 	content_t stair_desert_stone = CONTENT_IGNORE;
+	content_t tree               = CONTENT_IGNORE;
+	content_t leaves             = CONTENT_IGNORE;
+	content_t apple              = CONTENT_IGNORE;
+	content_t jungletree         = CONTENT_IGNORE;
+	content_t jungleleaves       = CONTENT_IGNORE;
+	content_t junglegrass        = CONTENT_IGNORE;
+	content_t pine_tree          = CONTENT_IGNORE;
+	content_t pine_needles       = CONTENT_IGNORE;
 };
 
 class MapgenV6 : public Mapgen {
@@ -118,6 +134,11 @@ public:
 	Noise *noise_beach;
 	Noise *noise_biome;
 	Noise *noise_humidity;
+	FusedNoise2D *noise_terrain; // the five above noise_beach, together
+	float *terrain_level; // baseTerrainLevel of each column
+	Noise *noise_cave1;
+	Noise *noise_cave2;
+	Noise *noise_trees; // at the centers of the divisions of placeTreesAndJungleGrass
 	NoiseParams *np_cave;
 	NoiseParams *np_humidity;
 	NoiseParams *np_trees;
@@ -125,10 +146,36 @@ public:
 
 	NoiseParams np_dungeons;
 
+	// Optional, shared with other mapgens working on the same world
+	NoiseMapCache *noise_cache = nullptr;
+
+	// Optional; if set, the column loops of generateGround, addMud and
+	// growGrass are split across it, for a single chunk to be done sooner.
+	// Each column is done the same way either way, so is the result.
+	TaskPool *task_pool = nullptr;
+
+	// Tables of flowMud, kept to not reallocate them
+	std::vector<int> mudflow_heights;
+	std::vector<u8> mudflow_stuck;
+	std::vector<u64> mudflow_candidates;
+	std::vector<Block *> mudflow_blocks;
+
+	// The shapes trees take, MGV6_TREE_VARIANTS of each kind; a tree gets
+	// one at random
+	std::vector<treegen::TreeTemplate> trees;
+	std::vector<treegen::TreeTemplate> apple_trees;
+	std::vector<treegen::TreeTemplate> jungle_trees;
+	std::vector<treegen::TreeTemplate> pine_trees;
+	// The heightmap before placeTreesAndJungleGrass, which the trees grow on
+	std::vector<s16> tree_ground;
+	// Stone surface of each column, see terrainSurface
+	std::vector<s16> terrain_surface;
+
 	float freq_desert;
 	float freq_beach;
 	s16 dungeon_ymin;
 	s16 dungeon_ymax;
+	float cave_width;
 
 	MapV6Params c;
 
@@ -136,6 +183,8 @@ public:
 	~MapgenV6();
 
 	void makeChunk(BlockMakeData *data) override;
+	// Sets up the chunk for the generation stages; the first step of makeChunk
+	void prepareChunk(BlockMakeData *data);
 	int getGroundLevelAtPoint(v2s16 p) override;
 	int getSpawnLevelAtPoint(v2s16 p) override;
 
@@ -146,11 +195,17 @@ public:
 	virtual float baseTerrainLevelFromMap(int index);
 
 	s16 find_stone_level(v2s16 p2d);
+	// The manip reaches into the neighbouring chunks, which the original
+	// code never saw: these are its in_area and get_ign, for the full area
+	bool inFullArea(v3s16 p) const;
+	MapNode getFullAreaIgn(v3s16 p) const;
 	bool block_is_underground(u64 seed, v3s16 blockpos);
 	s16 find_ground_level_from_noise(u64 seed, v2s16 p2d, s16 precision);
 
 	float getHumidity(v2s16 p);
 	float getTreeAmount(v2s16 p);
+	// Of a division of placeTreesAndJungleGrass
+	float getTreeAmount(int index);
 	bool getHaveAppleTree(v2s16 p);
 	float getMudAmount(v2s16 p);
 	virtual float getMudAmount(int index);
@@ -161,14 +216,58 @@ public:
 
 	u32 get_blockseed(u64 seed, v3s16 p);
 
+	// Terrain of a chunk, as far as the terrain noise tells
+	enum ChunkClass {
+		CHUNK_AIR, // above the terrain and the water
+		CHUNK_WATER_AIR, // above the terrain but not the water
+		CHUNK_STONE, // below the terrain
+		CHUNK_MIXED, // crossed by the terrain surface
+	};
+
+	ChunkClass classifyChunk(s16 *surface_max_y);
+	// Generates a chunk other than CHUNK_MIXED, and its heightmap. Returns
+	// whether it is all air, which it lights as well.
+	bool generateBulk(ChunkClass chunk_class);
+
 	virtual void calculateNoise();
+	void calculateTerrainNoise(float x, float z);
+	void calculateNoiseMap(Noise *noise, float x, float xoff, float z, float zoff);
 	int generateGround();
 	void addMud();
+	// Same result as flowMudReference, and keeps the heightmap up to date.
+	// Expects the state addMud leaves: an exact heightmap, no grass, and
+	// every column solid (water counts) from the chunk bottom to its top.
 	void flowMud(s16 &mudflow_minpos, s16 &mudflow_maxpos);
+	// The original, scanning every column; leaves the heightmap stale
+	void flowMudReference(s16 &mudflow_minpos, s16 &mudflow_maxpos);
 	void moveMud(v3s16 remove_index, v3s16 place_index,
 		v3s16 above_remove_index, v2s16 pos);
+	// Carves caves where the two cave noises are both near zero, up to
+	// max_stone_y, and keeps the heightmap up to date
+	void generateCaves(int max_stone_y);
 	void growGrass();
+	// Keeps the heightmap up to date. Trees may reach out of the chunk into
+	// the rest of the manip.
 	void placeTreesAndJungleGrass();
-// 	virtual void generateCaves(int max_stone_y);
+	// The stone surface of each column, before mud and caves, for
+	// calcLighting to tell the columns the terrain goes on above. Unlike
+	// the heightmap, it is not limited to the chunk.
+	const s16 *terrainSurface();
+
+	// Calls fn for ranges of rows [z_min, z_max] covering the given one,
+	// in parallel if there is task_pool
+	template <typename F>
+	void forRows(s16 z_min, s16 z_max, F &&fn)
+	{
+		int rows = z_max - z_min + 1;
+		unsigned parts = task_pool ? std::min<unsigned>(task_pool->threads(), rows) : 1;
+		if (parts <= 1) {
+			fn(z_min, z_max);
+			return;
+		}
+		task_pool->run(parts, [&] (unsigned k) {
+			fn(z_min + rows * k / parts, z_min + rows * (k + 1) / parts - 1);
+		});
+	}
 };
 
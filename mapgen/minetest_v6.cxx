@@ -0,0 +1,70 @@
+#include "minetest_v6.hxx"
+#include "mapgen/minetest/v6/mapgen_v6.hxx"
+
+MapV6Params mapgen_v6_content_ids() {
+	MapV6Params map_params;
+	map_params.stone = 1;
+	map_params.dirt = 2;
+	map_params.dirt_with_grass = 3;
+	map_params.sand = 4;
+	map_params.water_source = 5;
+	map_params.lava_source = 6;
+	map_params.gravel = 7;
+	map_params.desert_stone = 8;
+	map_params.desert_sand = 9;
+	map_params.dirt_with_snow = 10;
+	map_params.snow = 11;
+	map_params.snowblock = 12;
+	map_params.ice = 13;
+	map_params.cobble = 14;
+	map_params.mossycobble = 15;
+	map_params.stair_cobble = 16;
+	map_params.stair_desert_stone = 17;
+	map_params.tree = 18;
+	map_params.leaves = 19;
+	map_params.apple = 20;
+	map_params.jungletree = 21;
+	map_params.jungleleaves = 22;
+	map_params.junglegrass = 23;
+	map_params.pine_tree = 24;
+	map_params.pine_needles = 25;
+	return map_params;
+}
+
+MinetestMapgenV6::MinetestMapgenV6(int seed, int chunk_size, NoiseMapCache *noise_cache) :
+	params(std::make_unique<MapgenV6Params>())
+{
+	params->seed = seed;
+	params->chunksize = chunk_size;
+	mapgen = std::make_unique<MapgenV6>(params.get(), mapgen_v6_content_ids());
+	mapgen->noise_cache = noise_cache;
+}
+
+MinetestMapgenV6::~MinetestMapgenV6() = default;
+
+int MinetestMapgenV6::chunkSize() const {
+	return params->chunksize;
+}
+
+int MinetestMapgenV6::chunkPadding() const {
+	return CHUNK_PADDING_BLOCKS;
+}
+
+void MinetestMapgenV6::generate(MMVManip &vm, BlockPos base) {
+	BlockMakeData bmd;
+	bmd.seed = params->seed;
+	bmd.vmanip = &vm;
+	bmd.blockpos_min = vcore_to_mt(base);
+	bmd.blockpos_max = vcore_to_mt(base + (params->chunksize - 1));
+	mapgen->makeChunk(&bmd);
+}
+
+void MinetestMapgenV6::setLatencyMode(bool enable) {
+	if (enable && !pool)
+		pool = std::make_unique<TaskPool>();
+	mapgen->task_pool = enable ? pool.get() : nullptr;
+}
+
+int MinetestMapgenV6::getSpawnLevel(glm::ivec2 column) {
+	return mapgen->getSpawnLevelAtPoint({column.x, column.y});
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <memory>
+#include "interface.hxx"
+
+class MapgenV6;
+class NoiseMapCache;
+class TaskPool;
+struct MapgenV6Params;
+struct MapV6Params;
+
+/// Content ids of the nodes mapgen v6 places, as vcore numbers them.
+MapV6Params mapgen_v6_content_ids();
+
+/// Minetest’s mapgen v6, behind the IMapgen interface.
+class MinetestMapgenV6: public IMapgen {
+	std::unique_ptr<MapgenV6Params> params;
+	std::unique_ptr<MapgenV6> mapgen;
+	std::unique_ptr<TaskPool> pool; ///< created on first use of the latency mode
+
+public:
+	/// @param chunk_size Chunk edge, in blocks. Smaller chunks are done
+	/// sooner, larger ones take less time per node.
+	/// @param noise_cache Cache to share the noise maps through, may be null.
+	explicit MinetestMapgenV6(int seed, int chunk_size = 5, NoiseMapCache *noise_cache = nullptr);
+	~MinetestMapgenV6() override;
+
+	int chunkSize() const override;
+	int chunkPadding() const override;
+	void generate(MMVManip &vm, BlockPos base) override;
+	void setLatencyMode(bool enable) override;
+	int getSpawnLevel(glm::ivec2 column) override;
+};
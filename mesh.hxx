@@ -15,5 +15,6 @@ struct Vertex {
 using Index = std::uint16_t;
 
 struct Mesh {
+	glm::ivec3 origin; ///< Position of the mesh block minimum, in qubes
 	std::vector<Vertex> vertices;
 };
@@ -0,0 +1,31 @@
+#include <array>
+#include <glm/vec3.hpp>
+
+extern std::array<glm::vec3, 26> const content_colors = {{
+	[0] = {1.0f, 1.0f, 1.0f}, // air
+	[1] = {0.5f, 0.5f, 0.5f}, // stone
+	[2] = {0.5f, 0.2f, 0.1f}, // dirt
+	[3] = {0.2f, 0.6f, 0.0f}, // dirt_with_grass
+	[4] = {0.9f, 0.8f, 0.6f}, // sand
+	[5] = {0.3f, 0.4f, 0.9f}, // water_source
+	[6] = {0.9f, 0.6f, 0.0f}, // lava_source
+	[7] = {0.3f, 0.3f, 0.3f}, // gravel
+	[8] = {0.0f, 0.0f, 0.0f}, // desert_stone
+	[9] = {0.0f, 0.0f, 0.0f}, // desert_sand
+	[10] = {0.7f, 0.8f, 0.9f}, // dirt_with_snow
+	[11] = {0.0f, 0.0f, 0.0f}, // snow
+	[12] = {0.8f, 0.9f, 1.0f}, // snowblock
+	[13] = {0.6f, 0.7f, 1.0f}, // ice
+	[14] = {0.0f, 0.0f, 0.0f}, // cobble
+	[15] = {0.0f, 0.0f, 0.0f}, // mossycobble
+	[16] = {0.0f, 0.0f, 0.0f}, // stair_cobble
+	[17] = {0.0f, 0.0f, 0.0f}, // stair_desert_stone
+	[18] = {0.4f, 0.3f, 0.2f}, // tree
+	[19] = {0.1f, 0.4f, 0.1f}, // leaves
+	[20] = {0.7f, 0.1f, 0.1f}, // apple
+	[21] = {0.4f, 0.3f, 0.2f}, // jungletree
+	[22] = {0.1f, 0.4f, 0.0f}, // jungleleaves
+	[23] = {0.3f, 0.6f, 0.1f}, // junglegrass
+	[24] = {0.3f, 0.2f, 0.1f}, // pine_tree
+	[25] = {0.0f, 0.3f, 0.1f}, // pine_needles
+}};
@@ -3,9 +3,22 @@
 #include "slices.hxx"
 #include "swizzle.hxx"
 
+/// Brightness of a face with @p light in front of it, by the day light; each
+/// level below the sunlight is 0.8 times as bright
+inline float light_brightness(param_t light) {
+	static std::array<float, LIGHT_SUN + 1> const table = [] {
+		std::array<float, LIGHT_SUN + 1> table;
+		table[LIGHT_SUN] = 1.0f;
+		for (int k = LIGHT_SUN; k > 0; k--)
+			table[k - 1] = 0.8f * table[k];
+		return table;
+	}();
+	return table[light & 0x0F];
+}
+
 template <int level, glm::ivec3 transform(glm::ivec2)>
 void slice_to_mesh(std::vector<Vertex> &dest, Slice<level> const &slice, glm::ivec3 base, float brightness = 1.0f) {
-	extern std::array<glm::vec3, 18> const content_colors;
+	extern std::array<glm::vec3, 26> const content_colors;
 	int scale = 1 << level;
 	float inv_scale = 1.0f / slice.size * block_size / 16.0f;
 	for (int j = 0; j < slice.size; j++)
@@ -13,11 +26,12 @@ void slice_to_mesh(std::vector<Vertex> &dest, Slice<level> const &slice, glm::iv
 		content_t self = slice.get_r({i, j});
 		if (self == CONTENT_IGNORE)
 			continue;
-		auto color = brightness * content_colors.at(self);
+		float lit = brightness * light_brightness(slice.light[slice.index({i, j})]);
+		auto color = lit * content_colors.at(self);
 		auto make_vertex = [&] (int u, int v) {
 			auto ipos = glm::ivec2{i + u, j + v};
 			auto uv = inv_scale * glm::vec2(ipos);
-			dest.push_back({base + scale * transform(ipos), self, color, brightness, uv});
+			dest.push_back({base + scale * transform(ipos), self, color, lit, uv});
 		};
 		make_vertex(0, 0);
 		make_vertex(1, 0);
@@ -29,6 +43,7 @@ void slice_to_mesh(std::vector<Vertex> &dest, Slice<level> const &slice, glm::iv
 template <int h_level, int v_level>
 auto make_mesh(SliceSet<h_level, v_level> const &slices, glm::ivec3 offset) {
 	auto result = std::make_unique<Mesh>();
+	result->origin = offset;
 	result->vertices.reserve(4 * 3 * block_size * block_size * (block_size + 1));
 	for (int index = 0; index < MAP_BLOCKSIZE >> v_level; index++) {
 		int op = (index + 1) << v_level;
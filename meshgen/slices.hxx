@@ -6,6 +6,7 @@ struct Slice {
 	static constexpr int data_size = size * size;
 
 	content_t face[data_size];
+	param_t light[data_size]; ///< Of the air in front of each face
 
 	static int index_unsafe(glm::ivec2 pos) noexcept {
 		return pos.y + size * pos.x;
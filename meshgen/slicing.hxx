@@ -13,12 +13,20 @@ SliceSet<> make_slices(VManip const &mapfrag, glm::ivec3 blockpos) {
 		assert(self != CONTENT_IGNORE);
 		if (self == CONTENT_AIR)
 			continue;
-		if (mapfrag.get(pos + glm::ivec3{-1, 0, 0}).content == CONTENT_AIR) result.xn.at(block_size - 1 - rel.x).get_rw(pack_xn(rel)) = self;
-		if (mapfrag.get(pos + glm::ivec3{ 1, 0, 0}).content == CONTENT_AIR) result.xp.at(rel.x).get_rw(pack_xp(rel)) = self;
-		if (mapfrag.get(pos + glm::ivec3{0, -1, 0}).content == CONTENT_AIR) result.yn.at(block_size - 1 - rel.y).get_rw(pack_yn(rel)) = self;
-		if (mapfrag.get(pos + glm::ivec3{0,  1, 0}).content == CONTENT_AIR) result.yp.at(rel.y).get_rw(pack_yp(rel)) = self;
-		if (mapfrag.get(pos + glm::ivec3{0, 0, -1}).content == CONTENT_AIR) result.zn.at(block_size - 1 - rel.z).get_rw(pack_zn(rel)) = self;
-		if (mapfrag.get(pos + glm::ivec3{0, 0,  1}).content == CONTENT_AIR) result.zp.at(rel.z).get_rw(pack_zp(rel)) = self;
+		auto face = [&] (Slice<0> &slice, glm::ivec2 at, glm::ivec3 dir) {
+			Qube const &front = mapfrag.get(pos + dir);
+			if (front.content != CONTENT_AIR)
+				return;
+			int index = slice.index(at);
+			slice.face[index] = self;
+			slice.light[index] = front.light;
+		};
+		face(result.xn.at(block_size - 1 - rel.x), pack_xn(rel), {-1, 0, 0});
+		face(result.xp.at(rel.x), pack_xp(rel), { 1, 0, 0});
+		face(result.yn.at(block_size - 1 - rel.y), pack_yn(rel), {0, -1, 0});
+		face(result.yp.at(rel.y), pack_yp(rel), {0,  1, 0});
+		face(result.zn.at(block_size - 1 - rel.z), pack_zn(rel), {0, 0, -1});
+		face(result.zp.at(rel.z), pack_zp(rel), {0, 0,  1});
 	}
 	return result;
 }
@@ -27,9 +35,9 @@ template <int h_level>
 Slice<h_level> merge_slices(Slice<h_level> const &bottom, Slice<h_level> const &top) {
 	Slice<h_level> result;
 	for (int k = 0; k < result.data_size; k++) {
-		content_t t = top.face[k];
-		content_t b = bottom.face[k];
-		result.face[k] = t == CONTENT_IGNORE ? b : t;
+		Slice<h_level> const &from = top.face[k] == CONTENT_IGNORE ? bottom : top;
+		result.face[k] = from.face[k];
+		result.light[k] = from.light[k];
 	}
 	return result;
 }
@@ -58,25 +66,25 @@ template <int h_level>
 Slice<h_level + 1> hmerge_slice(Slice<h_level> const &slice) {
 	static std::mt19937 rnd(std::time(nullptr));
 	Slice<h_level + 1> result;
-	std::vector<content_t> v;
+	std::vector<int> v; ///< indices of the faces to pick from
 	v.reserve(4);
 	for (int j = 0; j < result.size; j++)
 	for (int i = 0; i < result.size; i++) {
 		v.clear();
-		content_t a = slice.get_r({2 * i    , 2 * j    });
-		content_t b = slice.get_r({2 * i    , 2 * j + 1});
-		content_t c = slice.get_r({2 * i + 1, 2 * j    });
-		content_t d = slice.get_r({2 * i + 1, 2 * j + 1});
-		if (a != CONTENT_IGNORE) v.push_back(a);
-		if (b != CONTENT_IGNORE) v.push_back(b);
-		if (c != CONTENT_IGNORE) v.push_back(c);
-		if (d != CONTENT_IGNORE) v.push_back(d);
-		content_t r = CONTENT_IGNORE;
+		for (glm::ivec2 sub: {glm::ivec2{0, 0}, glm::ivec2{0, 1}, glm::ivec2{1, 0}, glm::ivec2{1, 1}}) {
+			int index = slice.index(2 * glm::ivec2{i, j} + sub);
+			if (slice.face[index] != CONTENT_IGNORE)
+				v.push_back(index);
+		}
+		int index = result.index({i, j});
+		result.face[index] = CONTENT_IGNORE;
+		result.light[index] = 0xFF;
 		if (!v.empty()) {
 			std::uniform_int_distribution<std::size_t> dist{0, v.size() - 1};
-			r = v.at(dist(rnd));
+			int picked = v.at(dist(rnd));
+			result.face[index] = slice.face[picked];
+			result.light[index] = slice.light[picked];
 		}
-		result.get_rw({i, j}) = r;
 	}
 	return result;
 }
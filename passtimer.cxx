@@ -0,0 +1,62 @@
+#include "passtimer.hxx"
+#include <algorithm>
+#include <cstdint>
+#include <fmt/printf.h>
+#include <gl++/c.hxx>
+
+using namespace gl;
+
+float RollingStats::average() const noexcept {
+	if (!count)
+		return 0.0f;
+	float sum = 0.0f;
+	for (int k = 0; k < count; k++)
+		sum += samples[k];
+	return sum / count;
+}
+
+float RollingStats::maximum() const noexcept {
+	return count ? *std::max_element(samples.begin(), samples.begin() + count) : 0.0f;
+}
+
+void PassTimer::init() {
+	fn.CreateQueries(GL_TIME_ELAPSED, ring_size, queries.data());
+}
+
+void PassTimer::begin() {
+	collect();
+	cpu_begin = std::chrono::steady_clock::now();
+	active = !busy[next];
+	if (active)
+		fn.BeginQuery(GL_TIME_ELAPSED, queries[next]);
+}
+
+void PassTimer::end() {
+	if (active) {
+		fn.EndQuery(GL_TIME_ELAPSED);
+		busy[next] = true;
+		next = (next + 1) % ring_size;
+	}
+	cpu.add(std::chrono::duration<float>(std::chrono::steady_clock::now() - cpu_begin).count());
+}
+
+void PassTimer::collect() {
+	// queries complete in submission order, so stop at the first pending one
+	while (busy[oldest]) {
+		int available = 0;
+		fn.GetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+		std::uint64_t ns = 0;
+		fn.GetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &ns);
+		gpu.add(1e-9f * ns);
+		busy[oldest] = false;
+		oldest = (oldest + 1) % ring_size;
+	}
+}
+
+void PassTimer::log() const {
+	fmt::printf("%s: CPU %.3f ms avg, %.3f ms max; GPU %.3f ms avg, %.3f ms max\n", name,
+		1e3f * cpu.average(), 1e3f * cpu.maximum(),
+		1e3f * gpu.average(), 1e3f * gpu.maximum());
+}
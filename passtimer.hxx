@@ -0,0 +1,61 @@
+#pragma once
+#include <array>
+#include <chrono>
+
+/// Average and maximum over the last @c history samples.
+class RollingStats {
+public:
+	static constexpr int history = 120;
+
+	void add(float value) {
+		samples[next] = value;
+		next = (next + 1) % history;
+		if (count < history)
+			count++;
+	}
+
+	float average() const noexcept;
+	float maximum() const noexcept;
+	float last() const noexcept { return count ? samples[(next + history - 1) % history] : 0.0f; }
+
+private:
+	std::array<float, history> samples = {};
+	int count = 0;
+	int next = 0;
+};
+
+/// Measures a rendering pass, both the CPU time spent submitting it and the
+/// GPU time spent executing it. GPU results are read back a few frames later,
+/// from a ring of GL_TIME_ELAPSED queries, so measuring never stalls the
+/// pipeline; if the whole ring is still in flight the GPU side of the frame is
+/// skipped.
+class PassTimer {
+public:
+	explicit PassTimer(char const *name) : name(name) {}
+
+	/// Creates the query objects. Needs a current GL context.
+	void init();
+
+	void begin();
+	void end();
+
+	/// Fetches whatever query results are available, without waiting.
+	void collect();
+
+	/// Writes the current statistics to stdout.
+	void log() const;
+
+	char const *const name;
+	RollingStats cpu; ///< In seconds
+	RollingStats gpu; ///< In seconds
+
+private:
+	static constexpr int ring_size = 8;
+
+	std::array<unsigned, ring_size> queries = {};
+	std::array<bool, ring_size> busy = {};
+	int next = 0;
+	int oldest = 0;
+	bool active = false;
+	std::chrono::steady_clock::time_point cpu_begin;
+};
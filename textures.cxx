@@ -0,0 +1,267 @@
+#include "textures.hxx"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <optional>
+#include <system_error>
+#include <vector>
+#include <fmt/printf.h>
+#include <gl++/c.hxx>
+#include <SDL2/SDL_surface.h>
+#include <SDL2/SDL_image.h>
+#include "util/io.hxx"
+
+using namespace gl;
+namespace fs = std::filesystem;
+
+static constexpr auto extensions = {"png", "jpg"};
+static constexpr int mip_levels = 10;
+static constexpr int texture_size = 1 << (mip_levels - 1);
+static constexpr int type_count = 26;
+
+/*
+ * Cache file layout, all in native byte order:
+ *   CacheHeader
+ *   SourceStamp[type_count]
+ *   mip levels 0 to mip_levels - 1, each being all layers of tightly packed RGBA8.
+ * A cache entry is valid if every source has the recorded size and either the
+ * recorded mtime or, failing that, the recorded hash, in which case the new
+ * mtime is recorded.
+ */
+static constexpr char cache_magic[8] = {'V', 'C', 'T', 'E', 'X', 'A', 'R', 'R'};
+static constexpr std::uint32_t cache_version = 1;
+
+struct CacheHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t size;
+	std::uint32_t levels;
+	std::uint32_t layers;
+};
+
+struct SourceStamp {
+	std::int64_t mtime; ///< 0 if there is no source
+	std::uint64_t size;
+	std::uint64_t hash;
+};
+
+static std::size_t level_bytes(int level) {
+	std::size_t side = texture_size >> level;
+	return 4 * side * side * type_count;
+}
+
+static std::size_t chain_bytes() {
+	std::size_t total = 0;
+	for (int level = 0; level < mip_levels; level++)
+		total += level_bytes(level);
+	return total;
+}
+
+static fs::path find_source(fs::path const &root, int k) {
+	for (auto &&ext: extensions) {
+		auto filename = root / fmt::sprintf("textures/%d.%s", k, ext);
+		if (fs::exists(filename))
+			return filename;
+	}
+	return {};
+}
+
+static std::uint64_t hash_file(fs::path const &filename) {
+	// FNV-1a
+	mapped_file file(filename);
+	std::uint64_t hash = 14695981039346656037u;
+	for (std::size_t k = 0; k < file.size(); k++) {
+		hash ^= std::uint8_t(file.data()[k]);
+		hash *= 1099511628211u;
+	}
+	return hash;
+}
+
+static std::int64_t source_mtime(fs::path const &source) {
+	return fs::last_write_time(source).time_since_epoch().count();
+}
+
+static SourceStamp stamp_source(fs::path const &source) {
+	if (source.empty())
+		return {0, 0, 0};
+	return {source_mtime(source), fs::file_size(source), hash_file(source)};
+}
+
+/// Takes the mtime of a source that was touched but not changed into @p stamp
+static bool stamp_matches(SourceStamp &stamp, fs::path const &source) {
+	if (source.empty())
+		return stamp.mtime == 0;
+	if (stamp.size != fs::file_size(source))
+		return false;
+	std::int64_t mtime = source_mtime(source);
+	if (stamp.mtime == mtime)
+		return true;
+	if (stamp.hash != hash_file(source))
+		return false;
+	stamp.mtime = mtime;
+	return true;
+}
+
+/// Rewrites the stamps of a valid cache, so that touched sources are not
+/// hashed again on every start
+static void updateStamps(fs::path const &cache_file, std::vector<SourceStamp> const &stamps) {
+	FILE *f = fopen(cache_file.c_str(), "r+b");
+	if (!f) {
+		fmt::printf("Can't update texture cache %s: %s\n", cache_file.native(), std::strerror(errno));
+		return;
+	}
+	bool ok =
+		fseek(f, sizeof(CacheHeader), SEEK_SET) == 0 &&
+		fwrite(stamps.data(), sizeof(SourceStamp), stamps.size(), f) == stamps.size();
+	ok = fclose(f) == 0 && ok;
+	if (!ok)
+		fmt::printf("Can't update texture cache %s\n", cache_file.native());
+}
+
+static bool loadCache(unsigned texture, fs::path const &cache_file, std::vector<fs::path> const &sources) {
+	std::optional<mapped_file> file;
+	try {
+		file.emplace(cache_file);
+	} catch (std::system_error const &) {
+		return false;
+	}
+	std::size_t stamps_offset = sizeof(CacheHeader);
+	std::size_t pixels_offset = stamps_offset + sizeof(SourceStamp) * type_count;
+	if (file->size() != pixels_offset + chain_bytes())
+		return false;
+	CacheHeader header;
+	std::memcpy(&header, file->data(), sizeof(header));
+	if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+			header.version != cache_version ||
+			header.size != texture_size ||
+			header.levels != mip_levels ||
+			header.layers != type_count)
+		return false;
+	std::vector<SourceStamp> stamps(type_count);
+	std::memcpy(stamps.data(), file->data() + stamps_offset, sizeof(SourceStamp) * type_count);
+	bool touched = false;
+	for (int k = 0; k < type_count; k++) {
+		std::int64_t mtime = stamps[k].mtime;
+		if (!stamp_matches(stamps[k], sources[k]))
+			return false;
+		touched |= stamps[k].mtime != mtime;
+	}
+	std::byte const *pixels = file->data() + pixels_offset;
+	for (int level = 0; level < mip_levels; level++) {
+		int side = texture_size >> level;
+		fn.TextureSubImage3D(texture, level, 0, 0, 0, side, side, type_count, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		pixels += level_bytes(level);
+	}
+	file.reset();
+	if (touched)
+		updateStamps(cache_file, stamps);
+	return true;
+}
+
+static void saveCache(unsigned texture, fs::path const &cache_file, std::vector<SourceStamp> const &stamps) {
+	CacheHeader header;
+	std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.size = texture_size;
+	header.levels = mip_levels;
+	header.layers = type_count;
+	bytearray pixels(chain_bytes());
+	std::byte *level_pixels = pixels.data();
+	for (int level = 0; level < mip_levels; level++) {
+		fn.GetTextureImage(texture, level, GL_RGBA, GL_UNSIGNED_BYTE, level_bytes(level), level_pixels);
+		level_pixels += level_bytes(level);
+	}
+
+	// Write to a temporary file first so that a crash can’t leave a broken cache behind
+	fs::path tmp_file = cache_file;
+	tmp_file += ".tmp";
+	FILE *f = fopen(tmp_file.c_str(), "wb");
+	if (!f) {
+		fmt::printf("Can't write texture cache %s: %s\n", tmp_file.native(), std::strerror(errno));
+		return;
+	}
+	bool ok =
+		fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(stamps.data(), sizeof(SourceStamp), stamps.size(), f) == stamps.size() &&
+		fwrite(pixels.data(), pixels.size(), 1, f) == 1;
+	ok = fclose(f) == 0 && ok;
+	std::error_code err;
+	if (ok)
+		fs::rename(tmp_file, cache_file, err);
+	if (!ok || err) {
+		fmt::printf("Can't write texture cache %s\n", cache_file.native());
+		fs::remove(tmp_file, err);
+	}
+}
+
+static SDL_Surface *decodeTexture(fs::path const &source, int k) {
+	if (source.empty()) {
+		fmt::printf("Can't find image #%d\n", k);
+		return nullptr;
+	}
+	SDL_Surface *image = IMG_Load(source.c_str());
+	if (!image) {
+		fmt::printf("Can't load Image #%d: %s\n", k, SDL_GetError());
+		return nullptr;
+	}
+	if (image->w != texture_size || image->h != texture_size) {
+		fmt::printf("Wrong image #%d size: %dx%d instead of %d^2\n", k, image->w, image->h, texture_size);
+		SDL_FreeSurface(image);
+		return nullptr;
+	}
+	// Whatever the source format is, the texture wants RGBA8
+	SDL_Surface *rgba = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0);
+	if (!rgba)
+		fmt::printf("Can't convert image #%d: %s\n", k, SDL_GetError());
+	SDL_FreeSurface(image);
+	return rgba;
+}
+
+static void decodeTextures(unsigned texture, std::vector<fs::path> const &sources) {
+	std::vector<std::future<SDL_Surface *>> images;
+	for (int k = 1; k < type_count; k++)
+		images.push_back(std::async(std::launch::async, decodeTexture, sources[k], k));
+	for (int k = 1; k < type_count; k++) {
+		SDL_Surface *image = images[k - 1].get();
+		if (!image)
+			continue;
+		if (int err = SDL_LockSurface(image); err) {
+			fmt::printf("Can't lock surface of image #%d: %s\n", k, SDL_GetError());
+			SDL_FreeSurface(image);
+			continue;
+		}
+		fn.TextureSubImage3D(texture, 0, 0, 0, k, texture_size, texture_size, 1, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
+		SDL_UnlockSurface(image);
+		SDL_FreeSurface(image);
+	}
+	fn.GenerateTextureMipmap(texture);
+}
+
+unsigned loadNodeTextures(fs::path const &root, fs::path const &cache_file) {
+	auto t0 = std::chrono::steady_clock::now();
+	unsigned texture;
+	fn.CreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+	fn.TextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	fn.TextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+	fn.TextureStorage3D(texture, mip_levels, GL_RGBA8, texture_size, texture_size, type_count);
+
+	std::vector<fs::path> sources(type_count);
+	for (int k = 1; k < type_count; k++)
+		sources[k] = find_source(root, k);
+
+	bool cached = loadCache(texture, cache_file, sources);
+	if (!cached) {
+		// Stamp before decoding, so that a change made meanwhile invalidates the cache
+		std::vector<SourceStamp> stamps;
+		for (auto const &source: sources)
+			stamps.push_back(stamp_source(source));
+		decodeTextures(texture, sources);
+		saveCache(texture, cache_file, stamps);
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	fmt::printf("Textures %s in %.1f ms\n", cached ? "loaded from cache" : "decoded",
+		std::chrono::duration<double, std::milli>(t1 - t0).count());
+	return texture;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <filesystem>
+
+/// Creates the node texture array and fills it, together with its full mip
+/// chain. The result is cached in @p cache_file and reused on later runs as
+/// long as the source images stay the same.
+unsigned loadNodeTextures(std::filesystem::path const &root, std::filesystem::path const &cache_file);
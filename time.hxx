@@ -1,4 +1,5 @@
 #pragma once
+#include <cassert>
 #include <time.h>
 #include <errno.h>
 #include <system_error>
@@ -41,3 +42,10 @@ inline static timespec thread_cpu_clock() {
 		throw std::runtime_error("Per-thread CPU time clock is not supported");
 	throw std::system_error(errno, std::system_category(), "clock_gettime");
 }
+
+inline static timespec monotonic_clock() {
+	timespec x;
+	if (clock_gettime(CLOCK_MONOTONIC, &x) == 0)
+		return x;
+	throw std::system_error(errno, std::system_category(), "clock_gettime");
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <vector>
 #include <GLFW/glfw3.h>
 
 class FrameTimer {
@@ -23,15 +25,29 @@ public:
 	float dt() const noexcept { return delta; }
 	float fps() const noexcept { return calculated_fps; }
 
+	/// Frame time percentiles over the last FPS update interval, in seconds.
+	float p50() const noexcept { return calculated_p50; }
+	float p99() const noexcept { return calculated_p99; }
+
 private:
 	void update_fps() {
 		fps_time += delta;
 		fps_frames++;
+		frame_times.push_back(delta);
 		if (fps_time < fps_update_interval)
 			return;
 		calculated_fps = fps_frames / fps_time;
+		calculated_p50 = percentile(0.50f);
+		calculated_p99 = percentile(0.99f);
 		fps_time = 0.0f;
 		fps_frames = 0;
+		frame_times.clear();
+	}
+
+	float percentile(float p) {
+		auto nth = frame_times.begin() + std::min<std::size_t>(p * frame_times.size(), frame_times.size() - 1);
+		std::nth_element(frame_times.begin(), nth, frame_times.end());
+		return *nth;
 	}
 
 	double t_begin;
@@ -39,6 +55,9 @@ private:
 	long long frame = 0;
 
 	float calculated_fps = 1.0f;
+	float calculated_p50 = 0.0f;
+	float calculated_p99 = 0.0f;
 	int fps_frames = 0;
 	float fps_time = 0.0f;
+	std::vector<float> frame_times;
 };
@@ -0,0 +1,67 @@
+#include "upload.hxx"
+#include <algorithm>
+#include <gl++/c.hxx>
+#include <glm/geometric.hpp>
+#include "map/map.hxx"
+
+using namespace gl;
+
+static std::size_t mesh_bytes(Mesh const *mesh) {
+	return sizeof(Vertex) * mesh->vertices.size();
+}
+
+static glm::vec3 mesh_center(Mesh const *mesh) {
+	return glm::vec3(mesh->origin) + 0.5f * block_size;
+}
+
+GpuMesh UploadScheduler::allocate(Mesh const *mesh) {
+	std::size_t size = mesh_bytes(mesh);
+	if (pages.empty() || pages.back().used + size > pages.back().size) {
+		Page page{0, std::max(page_size, size), 0};
+		fn.CreateBuffers(1, &page.buffer);
+		fn.NamedBufferStorage(page.buffer, page.size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		pages.push_back(page);
+	}
+	Page &page = pages.back();
+	fn.NamedBufferSubData(page.buffer, page.used, size, mesh->vertices.data());
+	GpuMesh gpu{mesh, page.buffer, int(page.used / sizeof(Vertex)), int(mesh->vertices.size())};
+	page.used += size;
+	return gpu;
+}
+
+void UploadScheduler::enqueue(Mesh const *mesh) {
+	queue.push_back(mesh);
+	queue_bytes += mesh_bytes(mesh);
+}
+
+void UploadScheduler::upload(glm::vec3 eye_pos) {
+	last_bytes = 0;
+	last_count = 0;
+	if (queue.empty())
+		return;
+
+	// The camera moves, so priorities are recalculated every frame.
+	// Farthest first, as meshes are taken from the back.
+	std::vector<std::pair<float, Mesh const *>> order;
+	order.reserve(queue.size());
+	for (Mesh const *mesh: queue) {
+		glm::vec3 d = mesh_center(mesh) - eye_pos;
+		order.emplace_back(glm::dot(d, d), mesh);
+	}
+	std::sort(order.begin(), order.end(), [] (auto const &a, auto const &b) {
+		return a.first > b.first;
+	});
+
+	while (!order.empty() && (last_count == 0 || last_bytes < budget)) {
+		Mesh const *mesh = order.back().second;
+		order.pop_back();
+		uploaded.push_back(allocate(mesh));
+		last_bytes += mesh_bytes(mesh);
+		last_count++;
+	}
+
+	queue.clear();
+	for (auto it = order.rbegin(); it != order.rend(); ++it)
+		queue.push_back(it->second);
+	queue_bytes -= last_bytes;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "mesh.hxx"
+
+/// A mesh that resides in GPU memory.
+struct GpuMesh {
+	Mesh const *mesh;
+	unsigned buffer; ///< Arena page holding the mesh
+	int first; ///< Index of the first vertex of the mesh within @c buffer
+	int vertex_count;
+};
+
+/// Uploads new meshes to the GPU gradually, so that a large batch of meshes
+/// doesn’t stall a single frame. Meshes nearest to the camera go first.
+class UploadScheduler {
+public:
+	/// Upload limit per frame, in bytes. At least one mesh is uploaded per
+	/// frame anyway, so that a mesh larger than the budget can’t get stuck.
+	std::size_t budget = 4 << 20;
+
+	/// Size of a vertex arena page, in bytes. Meshes are packed into pages
+	/// back to back, so that consecutive draws mostly share a vertex buffer.
+	/// A mesh larger than that gets a page of its own.
+	static constexpr std::size_t page_size = 32 << 20;
+
+	void enqueue(Mesh const *mesh);
+	void upload(glm::vec3 eye_pos);
+
+	std::vector<GpuMesh> const &ready() const noexcept { return uploaded; }
+	std::size_t pending() const noexcept { return queue.size(); }
+	std::size_t pending_bytes() const noexcept { return queue_bytes; }
+
+	/// Statistics of the last @c upload call.
+	std::size_t frame_bytes() const noexcept { return last_bytes; }
+	int frame_uploads() const noexcept { return last_count; }
+
+	std::size_t page_count() const noexcept { return pages.size(); }
+
+private:
+	struct Page {
+		unsigned buffer;
+		std::size_t size;
+		std::size_t used;
+	};
+
+	GpuMesh allocate(Mesh const *mesh);
+
+	std::vector<Page> pages; ///< Only the last one gets new meshes
+	std::vector<Mesh const *> queue;
+	std::vector<GpuMesh> uploaded;
+	std::size_t queue_bytes = 0;
+	std::size_t last_bytes = 0;
+	int last_count = 0;
+};
@@ -3,6 +3,10 @@
 #include <exception>
 #include <system_error>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 bytearray read_file(std::string const &filename)
 {
@@ -24,3 +28,33 @@ bytearray read_file(std::string const &filename)
 		throw;
 	}
 }
+
+mapped_file::mapped_file(std::string const &filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::system_error(errno, std::generic_category(), "Can't open file " + filename);
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		int err = errno;
+		close(fd);
+		throw std::system_error(err, std::generic_category(), "Can't stat file " + filename);
+	}
+	length = st.st_size;
+	if (length) {
+		void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			int err = errno;
+			close(fd);
+			throw std::system_error(err, std::generic_category(), "Can't map file " + filename);
+		}
+		ptr = static_cast<std::byte const *>(p);
+	}
+	close(fd); // the mapping stays valid
+}
+
+mapped_file::~mapped_file()
+{
+	if (ptr)
+		munmap(const_cast<std::byte *>(ptr), length);
+}
@@ -1,7 +1,24 @@
 #pragma once
+#include <cstddef>
 #include <string>
 #include <vector>
 
 using bytearray = std::vector<std::byte>;
 
 bytearray read_file(std::string const &filename);
+
+/// Read-only memory mapping of a whole file.
+class mapped_file {
+public:
+	explicit mapped_file(std::string const &filename);
+	mapped_file(mapped_file const &) = delete;
+	mapped_file &operator= (mapped_file const &) = delete;
+	~mapped_file();
+
+	std::byte const *data() const noexcept { return ptr; }
+	std::size_t size() const noexcept { return length; }
+
+private:
+	std::byte const *ptr = nullptr;
+	std::size_t length = 0;
+};
@@ -1,38 +1,28 @@
 #include "perlin.hxx"
+#include <algorithm>
 #include <cmath>
 #include <array>
 #include <random>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 constexpr float smoothstep(float x)
 {
 	return (3.0f - 2.0f * x) * x * x;
 }
 
-glm::vec3 &PerlinNoise3d::point(int x, int y, int z)
+glm::vec4 &PerlinNoise3d::point(int x, int y, int z)
 {
 	return base_points[x + nodes[0] * (y + nodes[1] * z)];
 }
 
-glm::vec3 const &PerlinNoise3d::point(int x, int y, int z) const
+glm::vec4 const &PerlinNoise3d::point(int x, int y, int z) const
 {
 	return base_points[x + nodes[0] * (y + nodes[1] * z)];
 }
 
-float PerlinNoise3d::partial(std::array<int, 3> cell, std::array<float, 3> sub, std::array<bool, 3> mirror) const
-{
-	for (int k = 0; k < 3; ++k)
-		if (mirror[k]) {
-			cell[k] += 1;
-			sub[k] -= 1.0f;
-		}
-	float coef = 1.0f;
-	for (int k = 0; k < 3; ++k)
-		coef *= smoothstep(1.0f - std::fabs(sub[k]));
-	glm::vec3 base = point(cell[0], cell[1], cell[2]);
-	glm::vec3 shift {sub[0], sub[1], sub[2]};
-	return coef * glm::dot(shift, base);
-}
-
 PerlinNoise3d::PerlinNoise3d(int size_x, int size_y, int size_z) :
 		cells{size_x, size_y, size_z},
 		nodes{size_x + 1, size_y + 1, size_z + 1}
@@ -47,7 +37,7 @@ void PerlinNoise3d::generate(unsigned seed)
 	unsigned seed2 = prng();
 	for (int x = 0; x < nodes[0]; ++x)
 		for (int y = 0; y < nodes[1]; ++y) {
-			prng.seed(seed2 + x << 16 + y);
+			prng.seed(seed2 + (x << 16) + y);
 			for (int z = 0; z < nodes[2]; ++z)
 				for(;;) {
 					glm::vec3 vec {gen(prng), gen(prng), gen(prng)};
@@ -55,27 +45,184 @@ void PerlinNoise3d::generate(unsigned seed)
 					if ((len2 > 1.0f) || (len2 < 0.01f))
 						continue;
 					float c = 1.0f / std::sqrt(len2);
-					point(x, y, z) = c * vec;
+					point(x, y, z) = glm::vec4(c * vec, 0.0f);
 					break;
 				}
 		}
 }
 
+/*
+ * Each sample is the sum over the 8 corners of its cell of
+ *   w(sub.x - a) w(sub.y - b) w(sub.z - c) dot(grad(a, b, c), sub - (a, b, c))
+ * where w(t) = smoothstep(1 - |t|). Within a row (fixed y and z) the y and
+ * z parts only depend on the lattice column, so they are summed once per
+ * column into
+ *   px = sum w(sub.y - b) w(sub.z - c) grad.x
+ *   q  = sum w(sub.y - b) w(sub.z - c) (grad.y (sub.y - b) + grad.z (sub.z - c))
+ * and a sample in column cell n is then
+ *   w(sub.x) (px[n] sub.x + q[n]) + w(sub.x - 1) (px[n + 1] (sub.x - 1) + q[n + 1])
+ * which is the same arithmetic for every sample, done 4 at a time.
+ */
+
+/// The y and z parts of a row of samples
+struct PerlinNoise3d::Row {
+	int cy, cz;
+	float sy[2]; ///< sub.y - b
+	float sz[2]; ///< sub.z - c
+	float w[2][2]; ///< w(sub.y - b) w(sub.z - c)
+
+	Row(int cy, float suby, float wy0, float wy1, int cz, float subz, float wz0, float wz1) :
+		cy(cy), cz(cz),
+		sy{suby, suby - 1.0f},
+		sz{subz, subz - 1.0f},
+		w{{wy0 * wz0, wy0 * wz1}, {wy1 * wz0, wy1 * wz1}}
+	{
+	}
+};
+
+namespace {
+
+inline float blend(float w0, float w1, float sub, float px0, float q0, float px1, float q1)
+{
+	return w0 * (px0 * sub + q0) + w1 * (px1 * (sub - 1.0f) + q1);
+}
+
+struct Axis {
+	int first_cell;
+	std::vector<int> cell; ///< relative to first_cell
+	std::vector<float> sub;
+	std::vector<float> w0; ///< w(sub)
+	std::vector<float> w1; ///< w(sub - 1)
+	std::vector<int> used; ///< columns some sample needs, relative to first_cell
+
+	void setup(int count, float origin, float step, int cells)
+	{
+		if (step < 0.0f)
+			throw std::invalid_argument("Noise grid step must not be negative");
+		used.clear();
+		cell.resize(count);
+		sub.resize(count);
+		w0.resize(count);
+		w1.resize(count);
+		for (int i = 0; i < count; i++) {
+			float pos = origin + step * i;
+			int c = int(pos);
+			if ((c < 0) || (c >= cells))
+				throw std::range_error("Noise coordinates out of range");
+			if (i == 0)
+				first_cell = c;
+			cell[i] = c - first_cell;
+			sub[i] = pos - c;
+			w0[i] = smoothstep(1.0f - sub[i]);
+			w1[i] = smoothstep(sub[i]);
+			for (int n: {cell[i], cell[i] + 1})
+				if (used.empty() || used.back() < n)
+					used.push_back(n);
+		}
+	}
+
+	int columns() const
+	{
+		return cell.back() + 2;
+	}
+};
+
+/// Tables of PerlinNoise3d::add, kept to not reallocate them on every call
+struct Tables {
+	Axis x, y, z;
+	std::vector<float> px, q;
+};
+
+void interpolate_row(float *out, Axis const &x, float const *px, float const *q, float weight)
+{
+	int count = x.cell.size();
+	int i = 0;
+#if defined(__SSE2__)
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 vweight = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4) {
+		int const *c = &x.cell[i];
+		__m128 sub = _mm_loadu_ps(&x.sub[i]);
+		__m128 px0 = _mm_setr_ps(px[c[0]], px[c[1]], px[c[2]], px[c[3]]);
+		__m128 px1 = _mm_setr_ps(px[c[0] + 1], px[c[1] + 1], px[c[2] + 1], px[c[3] + 1]);
+		__m128 q0 = _mm_setr_ps(q[c[0]], q[c[1]], q[c[2]], q[c[3]]);
+		__m128 q1 = _mm_setr_ps(q[c[0] + 1], q[c[1] + 1], q[c[2] + 1], q[c[3] + 1]);
+		__m128 v0 = _mm_mul_ps(_mm_loadu_ps(&x.w0[i]), _mm_add_ps(_mm_mul_ps(px0, sub), q0));
+		__m128 v1 = _mm_mul_ps(_mm_loadu_ps(&x.w1[i]), _mm_add_ps(_mm_mul_ps(px1, _mm_sub_ps(sub, one)), q1));
+		__m128 v = _mm_add_ps(v0, v1);
+		_mm_storeu_ps(&out[i], _mm_add_ps(_mm_loadu_ps(&out[i]), _mm_mul_ps(vweight, v)));
+	}
+#endif
+	// same operations in the same order, so the result is the same either way
+	for (; i < count; i++) {
+		int c = x.cell[i];
+		out[i] += weight * blend(x.w0[i], x.w1[i], x.sub[i], px[c], q[c], px[c + 1], q[c + 1]);
+	}
+}
+
+}
+
+void PerlinNoise3d::column(int x, Row const &row, float &px, float &q) const
+{
+	float sum_px = 0.0f;
+	float sum_q = 0.0f;
+	for (int b = 0; b < 2; b++)
+	for (int c = 0; c < 2; c++) {
+		glm::vec4 const &g = point(x, row.cy + b, row.cz + c);
+		sum_px += row.w[b][c] * g.x;
+		sum_q += row.w[b][c] * (g.y * row.sy[b] + g.z * row.sz[c]);
+	}
+	px = sum_px;
+	q = sum_q;
+}
+
+void PerlinNoise3d::add(float *out, glm::ivec3 count, glm::vec3 origin, glm::vec3 step, float weight) const
+{
+	if (count.x <= 0 || count.y <= 0 || count.z <= 0)
+		return;
+	static thread_local Tables tables;
+	Axis &x = tables.x, &y = tables.y, &z = tables.z;
+	std::vector<float> &px = tables.px, &q = tables.q;
+	x.setup(count.x, origin.x, step.x, cells[0]);
+	y.setup(count.y, origin.y, step.y, cells[1]);
+	z.setup(count.z, origin.z, step.z, cells[2]);
+	px.resize(x.columns());
+	q.resize(x.columns());
+	for (int k = 0; k < count.z; k++)
+	for (int j = 0; j < count.y; j++) {
+		Row const row(y.first_cell + y.cell[j], y.sub[j], y.w0[j], y.w1[j],
+			z.first_cell + z.cell[k], z.sub[k], z.w0[k], z.w1[k]);
+		for (int n: x.used)
+			column(x.first_cell + n, row, px[n], q[n]);
+		interpolate_row(out + count.x * (j + count.y * k), x, px.data(), q.data(), weight);
+	}
+}
+
+void PerlinNoise3d::get(float *out, glm::ivec3 count, glm::vec3 origin, glm::vec3 step) const
+{
+	std::fill_n(out, count.x * count.y * count.z, 0.0f);
+	add(out, count, origin, step, 1.0f);
+}
+
 float PerlinNoise3d::get(float x, float y, float z) const
 {
-	std::array<float, 3> pos {x, y, z};
-	std::array<int, 3> cell;
-	std::array<float, 3> sub;
+	// a one-sample grid, without the tables
+	float pos[3] = {x, y, z};
+	int cell[3];
+	float sub[3];
 	for (int k = 0; k < 3; ++k) {
 		cell[k] = int(pos[k]);
-		if((cell[k] < 0) || (cell[k] >= cells[k]))
+		if ((cell[k] < 0) || (cell[k] >= cells[k]))
 			throw std::range_error("Noise coordinates out of range");
 		sub[k] = pos[k] - cell[k];
 	}
-	float value = 0;
-	for (int k = 0; k < 8; ++k)
-		value += partial(cell, sub, {k & 1, k & 2, k & 4});
-	return value;
+	Row const row(cell[1], sub[1], smoothstep(1.0f - sub[1]), smoothstep(sub[1]),
+		cell[2], sub[2], smoothstep(1.0f - sub[2]), smoothstep(sub[2]));
+	float px0, q0, px1, q1;
+	column(cell[0], row, px0, q0);
+	column(cell[0] + 1, row, px1, q1);
+	float v = blend(smoothstep(1.0f - sub[0]), smoothstep(sub[0]), sub[0], px0, q0, px1, q1);
+	return v;
 }
 
 float PerlinNoise3d::get(glm::vec3 v) const
@@ -99,13 +246,24 @@ void FractalNoise2d::generate(int seed)
 		noise[k].generate(seed + k);
 }
 
+void FractalNoise2d::get(float *out, glm::ivec2 count, glm::vec2 origin, glm::vec2 step) const
+{
+	std::fill_n(out, count.x * count.y, 0.0f);
+	float coef = 1.0f;
+	for (int k = 0; k < octaves; ++k) {
+		float s = (1 << k) * scale;
+		noise[k].add(out, glm::ivec3(count, 1), glm::vec3(s * origin, 0.3f), glm::vec3(s * step, 0.0f), coef);
+		coef *= persistence;
+	}
+}
+
 float FractalNoise2d::get(float x, float y) const
 {
 	float value = 0.0f;
 	float coef = 1.0f;
 	for (int k = 0; k < octaves; ++k) {
-		int scale2 = 1 << k;
-		value += coef * noise[k].get(scale2 * scale * x, scale2 * scale * y, 0.3f);
+		float s = (1 << k) * scale;
+		value += coef * noise[k].get(s * x, s * y, 0.3f);
 		coef *= persistence;
 	}
 	return value;
@@ -7,17 +7,30 @@ class PerlinNoise3d
 {
 	int const cells[3];
 	int const nodes[3];
-	std::vector<glm::vec3> base_points;
+	/// Gradients of the lattice nodes, x fastest. Padded to 16 bytes, so that
+	/// a node never straddles a cache line.
+	std::vector<glm::vec4> base_points;
 
-	glm::vec3 &point(int x, int y, int z);
-	glm::vec3 const &point(int x, int y, int z) const;
-	float partial(std::array<int, 3> cell, std::array<float, 3> sub, std::array<bool, 3> mirror) const;
+	glm::vec4 &point(int x, int y, int z);
+	glm::vec4 const &point(int x, int y, int z) const;
+
+	struct Row;
+	void column(int x, Row const &row, float &px, float &q) const;
 
 public:
 	PerlinNoise3d(int size_x, int size_y, int size_z);
 	void generate(unsigned seed);
 	float get(float x, float y, float z) const;
 	float get(glm::vec3 v) const;
+
+	/// Fills @p out with a @p count.x × @p count.y × @p count.z grid of
+	/// samples, x fastest; sample (i, j, k) is at `origin + step * (i, j, k)`.
+	/// Gives exactly what @c get would for each of these points.
+	/// @param step Must not be negative.
+	void get(float *out, glm::ivec3 count, glm::vec3 origin, glm::vec3 step) const;
+
+	/// Same as @c get, but adds @p weight times the samples to @p out.
+	void add(float *out, glm::ivec3 count, glm::vec3 origin, glm::vec3 step, float weight) const;
 };
 
 class FractalNoise2d
@@ -32,4 +45,9 @@ public:
 	void generate(int seed);
 	float get(float x, float y) const;
 	float get(glm::vec2 v) const;
+
+	/// Fills @p out with a @p count.x × @p count.y grid of samples, x fastest;
+	/// sample (i, j) is at `origin + step * (i, j)`. Matches @c get up to the
+	/// rounding of the positions, which are scaled per octave.
+	void get(float *out, glm::ivec2 count, glm::vec2 origin, glm::vec2 step) const;
 };